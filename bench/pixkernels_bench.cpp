@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "pixkernels.h"
+#include "pixutils.h"
+
+using ELS::PixKernels;
+using ELS::PixUtils;
+
+// Times the dispatched PixKernels against the plain scalar loops they
+// replaced, for every sample format, planar (stride 1) and interleaved
+// (stride 3), and checks the two agree. Exits non-zero on a mismatch.
+//
+// pixkernels_bench [width] [height] [repeats]
+
+static const int g_defaultWidth = 6000;
+static const int g_defaultHeight = 500;
+static const int g_defaultRepeats = 5;
+
+// Every so many floating point samples is NaN or infinite, so the
+// skipping path is timed as well
+static const int g_nonFiniteEvery = 997;
+
+// The scalar references stay scalar; otherwise the comparison is only
+// between two auto-vectorised loops
+#define SCALAR_REF __attribute__((noinline, optimize("no-tree-vectorize")))
+
+template <typename PixelT>
+SCALAR_REF static int scalarMinMaxSum(const PixelT* k, int count, int stride,
+                                      PixelT* minVal, PixelT* maxVal, double* sum)
+{
+    int folded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        PixelT v = k[(int64_t)i * stride];
+        if (!PixUtils::isFinite(v))
+        {
+            continue;
+        }
+        *minVal = std::min(*minVal, v);
+        *maxVal = std::max(*maxVal, v);
+        *sum += v;
+        folded++;
+    }
+    return folded;
+}
+
+template <typename PixelT>
+SCALAR_REF static void scalarRenderGray(const PixelT* k, int count, int stride,
+                                        const uint8_t* lut, uint8_t* out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = lut[PixUtils::convertRangeToHist(k[(int64_t)i * stride])];
+    }
+}
+
+template <typename PixelT>
+SCALAR_REF static void scalarRenderRgb(const PixelT* r, const PixelT* g, const PixelT* b,
+                                       int count, int stride, const uint8_t* rLut,
+                                       const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int64_t at = (int64_t)i * stride;
+        out[i] = 0xff000000u |
+                 ((uint32_t)rLut[PixUtils::convertRangeToHist(r[at])] << 16) |
+                 ((uint32_t)gLut[PixUtils::convertRangeToHist(g[at])] << 8) |
+                 (uint32_t)bLut[PixUtils::convertRangeToHist(b[at])];
+    }
+}
+
+// Integers over their whole range, floating point over [0, 1] with
+// the odd NaN or infinity
+template <typename PixelT>
+static void fillSamples(std::vector<PixelT>& samples, std::mt19937_64& rng)
+{
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        uint64_t bits = rng();
+        if (std::numeric_limits<PixelT>::is_integer)
+        {
+            samples[i] = (PixelT)bits;
+        }
+        else if (i % g_nonFiniteEvery == 0)
+        {
+            samples[i] = (i / g_nonFiniteEvery) % 2 ? std::numeric_limits<PixelT>::infinity()
+                                                    : std::numeric_limits<PixelT>::quiet_NaN();
+        }
+        else
+        {
+            samples[i] = (PixelT)((bits >> 11) * (1.0 / 9007199254740992.0));
+        }
+    }
+}
+
+// Best of repeats, in seconds
+template <typename WorkT>
+static double timeBest(int repeats, WorkT work)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repeats; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best;
+}
+
+static void report(const char* typeName,
+                   int stride,
+                   const char* kernel,
+                   double bytes,
+                   double scalarSecs,
+                   double dispatchedSecs,
+                   bool match)
+{
+    printf("%-8s stride %d  %-10s  scalar %7.2f GB/s  dispatched %7.2f GB/s  x%5.2f  %s\n",
+           typeName,
+           stride,
+           kernel,
+           bytes / scalarSecs / 1e9,
+           bytes / dispatchedSecs / 1e9,
+           scalarSecs / dispatchedSecs,
+           match ? "ok" : "MISMATCH");
+    fflush(stdout);
+}
+
+// Runs the three kernels over a width x height frame. At stride 1
+// the channels are planes; at stride 3 they are interleaved, as in
+// XISF normal pixel storage.
+template <typename PixelT>
+static bool benchFormat(const char* typeName,
+                        int stride,
+                        int width,
+                        int height,
+                        int repeats,
+                        std::mt19937_64& rng)
+{
+    const int64_t planeSamples = (int64_t)width * height;
+    std::vector<PixelT> samples(planeSamples * 3);
+    fillSamples(samples, rng);
+
+    const PixelT* chan[3];
+    for (int c = 0; c < 3; c++)
+    {
+        chan[c] = (stride == 1) ? &samples[planeSamples * c] : &samples[c];
+    }
+    const int64_t rowStep = (int64_t)width * stride;
+
+    const int lutPoints = PixUtils::getHistogramPoints<PixelT>();
+    std::vector<uint8_t> luts(lutPoints * 3);
+    for (size_t i = 0; i < luts.size(); i++)
+    {
+        luts[i] = (uint8_t)rng();
+    }
+    const uint8_t* rLut = &luts[0];
+    const uint8_t* gLut = &luts[lutPoints];
+    const uint8_t* bLut = &luts[lutPoints * 2];
+
+    bool allMatch = true;
+
+    // min, max and sum, one call per row as StatisticsVisitor makes
+    {
+        PixelT scalarMin = 0, scalarMax = 0, kernelMin = 0, kernelMax = 0;
+        double scalarSum = 0.0, kernelSum = 0.0;
+        int64_t scalarCount = 0, kernelCount = 0;
+
+        double scalarSecs = timeBest(repeats, [&]()
+                                     {
+                                         scalarMin = std::numeric_limits<PixelT>::max();
+                                         scalarMax = std::numeric_limits<PixelT>::lowest();
+                                         scalarSum = 0.0;
+                                         scalarCount = 0;
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             scalarCount += scalarMinMaxSum(chan[0] + rowStep * y, width, stride,
+                                                                            &scalarMin, &scalarMax, &scalarSum);
+                                         }
+                                     });
+        double kernelSecs = timeBest(repeats, [&]()
+                                     {
+                                         kernelMin = std::numeric_limits<PixelT>::max();
+                                         kernelMax = std::numeric_limits<PixelT>::lowest();
+                                         kernelSum = 0.0;
+                                         kernelCount = 0;
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             kernelCount += PixKernels::minMaxSum(chan[0] + rowStep * y, width, stride,
+                                                                                  &kernelMin, &kernelMax, &kernelSum);
+                                         }
+                                     });
+
+        // Integer rows sum exactly either way; floating point lanes
+        // add in a different order
+        double sumSlack = std::numeric_limits<PixelT>::is_integer ? 0.0 : 1e-9 * std::fabs(scalarSum);
+        bool match = scalarMin == kernelMin &&
+                     scalarMax == kernelMax &&
+                     scalarCount == kernelCount &&
+                     std::fabs(scalarSum - kernelSum) <= sumSlack;
+        report(typeName, stride, "minMaxSum", (double)planeSamples * sizeof(PixelT),
+               scalarSecs, kernelSecs, match);
+        allMatch = allMatch && match;
+    }
+
+    // Grey rendering
+    {
+        std::vector<uint8_t> scalarOut(planeSamples);
+        std::vector<uint8_t> kernelOut(planeSamples);
+
+        double scalarSecs = timeBest(repeats, [&]()
+                                     {
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             scalarRenderGray(chan[0] + rowStep * y, width, stride,
+                                                              rLut, &scalarOut[(int64_t)width * y]);
+                                         }
+                                     });
+        double kernelSecs = timeBest(repeats, [&]()
+                                     {
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             PixKernels::renderGray(chan[0] + rowStep * y, width, stride,
+                                                                    rLut, &kernelOut[(int64_t)width * y]);
+                                         }
+                                     });
+
+        bool match = scalarOut == kernelOut;
+        report(typeName, stride, "renderGray", (double)planeSamples * sizeof(PixelT),
+               scalarSecs, kernelSecs, match);
+        allMatch = allMatch && match;
+    }
+
+    // Colour rendering
+    {
+        std::vector<uint32_t> scalarOut(planeSamples);
+        std::vector<uint32_t> kernelOut(planeSamples);
+
+        double scalarSecs = timeBest(repeats, [&]()
+                                     {
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             scalarRenderRgb(chan[0] + rowStep * y,
+                                                             chan[1] + rowStep * y,
+                                                             chan[2] + rowStep * y,
+                                                             width, stride, rLut, gLut, bLut,
+                                                             &scalarOut[(int64_t)width * y]);
+                                         }
+                                     });
+        double kernelSecs = timeBest(repeats, [&]()
+                                     {
+                                         for (int y = 0; y < height; y++)
+                                         {
+                                             PixKernels::renderRgb(chan[0] + rowStep * y,
+                                                                   chan[1] + rowStep * y,
+                                                                   chan[2] + rowStep * y,
+                                                                   width, stride, rLut, gLut, bLut,
+                                                                   &kernelOut[(int64_t)width * y]);
+                                         }
+                                     });
+
+        bool match = scalarOut == kernelOut;
+        report(typeName, stride, "renderRgb", (double)planeSamples * sizeof(PixelT) * 3,
+               scalarSecs, kernelSecs, match);
+        allMatch = allMatch && match;
+    }
+
+    return allMatch;
+}
+
+template <typename PixelT>
+static bool benchFormat(const char* typeName,
+                        int width,
+                        int height,
+                        int repeats,
+                        std::mt19937_64& rng)
+{
+    bool planar = benchFormat<PixelT>(typeName, 1, width, height, repeats, rng);
+    bool interleaved = benchFormat<PixelT>(typeName, 3, width, height, repeats, rng);
+    return planar && interleaved;
+}
+
+int main(int argc, char* argv[])
+{
+    int width = (argc > 1) ? atoi(argv[1]) : g_defaultWidth;
+    int height = (argc > 2) ? atoi(argv[2]) : g_defaultHeight;
+    int repeats = (argc > 3) ? atoi(argv[3]) : g_defaultRepeats;
+    if (width < 1 || height < 1 || repeats < 1)
+    {
+        printf("usage: %s [width] [height] [repeats]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%dx%d, best of %d, one thread\n", width, height, repeats);
+    fflush(stdout);
+
+    std::mt19937_64 rng(20211021);
+    bool allMatch = true;
+    allMatch = benchFormat<int8_t>("int8", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<int16_t>("int16", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<int32_t>("int32", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<uint8_t>("uint8", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<uint16_t>("uint16", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<uint32_t>("uint32", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<float>("float", width, height, repeats, rng) && allMatch;
+    allMatch = benchFormat<double>("double", width, height, repeats, rng) && allMatch;
+
+    return allMatch ? 0 : 1;
+}
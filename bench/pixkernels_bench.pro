@@ -0,0 +1,22 @@
+# Microbenchmark for the PixKernels, kept out of the default build.
+# From an empty build directory: qmake ../bench/pixkernels_bench.pro && make
+
+TEMPLATE = app
+TARGET = pixkernels_bench
+
+CONFIG += console c++17
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += \
+    ../image/raster/include
+
+SOURCES += \
+    pixkernels_bench.cpp \
+    ../image/raster/src/pixkernels.cpp \
+    ../image/raster/src/pixutils.cpp \
+    ../image/raster/src/pixstfparms.cpp
+
+HEADERS += \
+    ../image/raster/include/pixkernels.h \
+    ../image/raster/include/pixutils.h \
+    ../image/raster/include/pixstfparms.h
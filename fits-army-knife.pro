@@ -29,15 +29,28 @@ SOURCES += \
     image/fits/src/fitstantrum.cpp \
     image/xisf/src/xisfexception.cpp \
     image/xisf/src/xisfimage.cpp \
+    image/xisf/src/sha1.cpp \
     image/raster/src/imageloadexception.cpp \
     image/raster/src/image.cpp \
     image/raster/src/pixelvisitortypemismatch.cpp \
     image/raster/src/pixelvisitor.cpp \
     image/raster/src/pixutils.cpp \
+    image/raster/src/pixkernels.cpp \
+    image/raster/src/parallelfor.cpp \
     image/raster/src/pixstfparms.cpp \
     gui/src/main.cpp \
+    gui/src/compacthistogram.cpp \
+    gui/src/dirscanner.cpp \
+    gui/src/displayrenderer.cpp \
+    gui/src/folderwatcher.cpp \
     gui/src/mainwindow.cpp \
+    gui/src/imagecache.cpp \
     gui/src/imagefilelistitem.cpp \
+    gui/src/imageloader.cpp \
+    gui/src/imagestore.cpp \
+    gui/src/lutstore.cpp \
+    gui/src/prefetchpolicy.cpp \
+    gui/src/tilecache.cpp \
     gui/src/imagewidget.cpp \
     gui/src/histogramwidget.cpp
 
@@ -48,17 +61,31 @@ HEADERS += \
     $$PCL_INCLUDE_DIR/pcl/XISF.h \
     image/xisf/include/xisfexception.h \
     image/xisf/include/xisfimage.h \
+    image/xisf/include/sha1.h \
     image/raster/include/imageloadexception.h \
     image/raster/include/image.h \
     image/raster/include/rastertypes.h \
     image/raster/include/pixelvisitortypemismatch.h \
     image/raster/include/pixelvisitor.h \
     image/raster/include/pixutils.h \
+    image/raster/include/orderstatisticsvisitor.h \
+    image/raster/include/pixkernels.h \
+    image/raster/include/parallelfor.h \
     image/raster/include/pixstatistics.h \
     image/raster/include/pixstfparms.h \
     image/raster/include/statisticsvisitor.h \
     gui/include/mainwindow.h \
+    gui/include/compacthistogram.h \
+    gui/include/dirscanner.h \
+    gui/include/displayrenderer.h \
+    gui/include/folderwatcher.h \
+    gui/include/imagecache.h \
     gui/include/imagefilelistitem.h \
+    gui/include/imageloader.h \
+    gui/include/imagestore.h \
+    gui/include/lutstore.h \
+    gui/include/prefetchpolicy.h \
+    gui/include/tilecache.h \
     gui/include/imagewidget.h \
     gui/include/histogramwidget.h
 
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <inttypes.h>
+#include <memory>
+#include <vector>
+
+// A histogram packed for keeping while its item isn't shown. Runs of
+// non-empty bins are stored as the number of empty bins before the
+// run, the run's length, then its counts, all as LEB128 varints.
+// Astro frames fill a narrow band of bins with mostly small counts, so
+// this is a small fraction of the full table. It's lossless, so the
+// item's statistics and LUTs stay valid when it's expanded again.
+class CompactHistogram
+{
+public:
+    CompactHistogram(const uint32_t* data,
+                     int totalPoints);
+    ~CompactHistogram();
+
+    int64_t getMemoryUsage() const;
+
+    // The full table, every channel, as it was packed
+    std::shared_ptr<uint32_t[]> expand() const;
+
+private:
+    void put(uint32_t val);
+    static uint32_t get(const uint8_t** next);
+
+private:
+    int _totalPoints;
+    std::vector<uint8_t> _packed;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QDir>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+
+#include "imagefilelistitem.h"
+
+// Validates command line files and the contents of command line
+// directories on a bounded worker pool. Files are reported as they
+// are probed, so the first ones arrive long before a large scan
+// finishes. Each file carries an order key that sorts the results
+// the way a serial scan would have listed them.
+class DirScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirScanner(QObject* parent = nullptr);
+    ~DirScanner();
+
+    void scan(const QList<QString>& absoluteFilePaths,
+              const QList<QDir>& dirs);
+
+public:
+    // Probing is mostly waiting on the filesystem, so this can run
+    // well past the core count; it's bounded so a network mount
+    // isn't flooded
+    static const int g_maxThreads = 16;
+
+signals:
+    // Emitted on the thread this object lives in
+    void fileFound(qint64 order, ImageFileListItem item);
+    void finished();
+
+    // Emitted from worker threads
+    void fileProbed(qint64 order, ImageFileListItem item);
+    void scanDrained();
+
+private:
+    void startTask(QRunnable* task);
+    void taskFinished();
+    bool claimPath(const QString& absolutePath);
+
+private:
+    class ListTask : public QRunnable
+    {
+    public:
+        ListTask(DirScanner* scanner,
+                 const QDir& dir,
+                 int dirIdx);
+        ~ListTask();
+
+        virtual void run() override;
+
+    private:
+        DirScanner* _scanner;
+        QDir _dir;
+        int _dirIdx;
+    };
+
+    class ProbeTask : public QRunnable
+    {
+    public:
+        ProbeTask(DirScanner* scanner,
+                  const QString& absolutePath,
+                  qint64 order);
+        ~ProbeTask();
+
+        virtual void run() override;
+
+    private:
+        DirScanner* _scanner;
+        QString _absolutePath;
+        qint64 _order;
+    };
+
+private:
+    QThreadPool _pool;
+    QMutex _seenMutex;
+    QSet<QString> _seen;
+    std::atomic<int> _outstanding;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QImage>
+#include <QRect>
+
+#include "image.h"
+#include "pixelvisitor.h"
+
+// What ImageWidget shows. Renders any part of an image on request, at
+// a reduced resolution when zoomed out, straight from the raw pixels
+// and a display LUT. Images too big to hold raw (streamed FITS) come
+// as a finished render instead, box-filtered down by a power of 2
+// until it fits in memory, which is sampled the same way; closer in
+// than that, its pixels are repeated. Once buildPyramid() has run,
+// zoomed-out renders come from box-filtered 2x, 4x and 8x reductions
+// of the full render instead.
+// Grey images render to Grayscale8, colour to RGB32.
+// Rendering doesn't change the object, so one can be shared between
+// threads.
+class DisplayRenderer
+{
+public:
+    DisplayRenderer(std::shared_ptr<const ELS::Image> image,
+                    std::shared_ptr<const uint8_t[]> lut,
+                    int lutPoints,
+                    bool lutIsIdentity = false);
+    // frame is the render of a width x height image reduced by
+    // frameScale, a power of 2
+    DisplayRenderer(std::shared_ptr<const QImage> frame,
+                    int width,
+                    int height,
+                    int frameScale = 1);
+    ~DisplayRenderer();
+
+    int width() const;
+    int height() const;
+
+    // Unique to this renderer, so to its image and stretch, for the
+    // lifetime of the process
+    quint64 getId() const;
+
+    // Bytes held by whole-image renders: the streamed image's frame
+    // and the pyramid levels. Unstretched uint8 grey images are shown
+    // from their own samples, which aren't counted.
+    int64_t getMemoryUsage() const;
+
+    // Render the pyramid levels, using all cores. Call it before the
+    // renderer is shared; it's worth it for anything that will be
+    // shown zoomed out.
+    void buildPyramid();
+
+    // Every reduction'th column of every reduction'th row of source
+    // (in image pixels, clipped to the image), starting at its top
+    // left. Reductions of 2 and up take the deepest pyramid level that
+    // divides them, so each output pixel is a box-filtered mean rather
+    // than a single sample. A full-frame render at a reduction of 1 is
+    // the whole image, e.g. for export; at the resolution of the frame
+    // for a streamed image.
+    QImage render(const QRect& source,
+                  int reduction) const;
+
+private:
+    static std::atomic<quint64> g_nextId;
+    // Deepest level is 8x
+    static const int g_pyramidLevels;
+    // Output rows per unit of work when building the pyramid
+    static const int g_pyramidBandRows;
+    // The same for renders from the raw pixels
+    static const int g_renderBandRows;
+
+    // Box filter rows [firstRow, lastRow) of a level from src, whose
+    // first row is row srcTop of the level above
+    static void halveRows(const QImage& src,
+                          int srcTop,
+                          uchar* dstBits,
+                          int dstBytesPerLine,
+                          int firstRow,
+                          int lastRow);
+
+    class RegionVisitor : public ELS::PixelVisitor
+    {
+    public:
+        RegionVisitor(const uint8_t* lut,
+                      int lutPoints,
+                      const QRect& source,
+                      int reduction,
+                      uchar* outBits,
+                      int outBytesPerLine,
+                      int outWidth);
+        ~RegionVisitor();
+
+    public:
+        virtual void pixelFormat(ELS::PixelFormat pf) override;
+        virtual void dimensions(int width, int height) override;
+        virtual void rowInfo(int stride) override;
+
+        virtual void rowGray(int y,
+                             const int8_t* k) override;
+        virtual void rowGray(int y,
+                             const int16_t* k) override;
+        virtual void rowGray(int y,
+                             const int32_t* k) override;
+        virtual void rowGray(int y,
+                             const uint8_t* k) override;
+        virtual void rowGray(int y,
+                             const uint16_t* k) override;
+        virtual void rowGray(int y,
+                             const uint32_t* k) override;
+        virtual void rowGray(int y,
+                             const float* k) override;
+        virtual void rowGray(int y,
+                             const double* k) override;
+
+        virtual void rowRgb(int y,
+                            const int8_t* r,
+                            const int8_t* g,
+                            const int8_t* b) override;
+        virtual void rowRgb(int y,
+                            const int16_t* r,
+                            const int16_t* g,
+                            const int16_t* b) override;
+        virtual void rowRgb(int y,
+                            const int32_t* r,
+                            const int32_t* g,
+                            const int32_t* b) override;
+        virtual void rowRgb(int y,
+                            const uint8_t* r,
+                            const uint8_t* g,
+                            const uint8_t* b) override;
+        virtual void rowRgb(int y,
+                            const uint16_t* r,
+                            const uint16_t* g,
+                            const uint16_t* b) override;
+        virtual void rowRgb(int y,
+                            const uint32_t* r,
+                            const uint32_t* g,
+                            const uint32_t* b) override;
+        virtual void rowRgb(int y,
+                            const float* r,
+                            const float* g,
+                            const float* b) override;
+        virtual void rowRgb(int y,
+                            const double* r,
+                            const double* g,
+                            const double* b) override;
+
+        virtual void done() override;
+
+    private:
+        template <typename PixelT>
+        void gray(int y,
+                  const PixelT* k);
+
+        template <typename PixelT>
+        void rgb(int y,
+                 const PixelT* r,
+                 const PixelT* g,
+                 const PixelT* b);
+
+    private:
+        const uint8_t* _lut;
+        int _lutPoints;
+        QRect _source;
+        int _reduction;
+        int _stride;
+        // Rows of the output image, fetched once up front; scanLine()
+        // on a shared QImage isn't safe from several threads
+        uchar* _outBits;
+        int _outBytesPerLine;
+        int _outWidth;
+    };
+
+private:
+    quint64 _id;
+    std::shared_ptr<const ELS::Image> _image;
+    std::shared_ptr<const uint8_t[]> _lut;
+    int _lutPoints;
+    QImage::Format _format;
+    int _width;
+    int _height;
+    // The streamed image's render, or a view of an image's own bytes
+    std::shared_ptr<const QImage> _frame;
+    // How much _frame is reduced by
+    int _frameScale;
+    // _levels[i] is reduced by 2^(i + 1); empty until buildPyramid(),
+    // and null where _frame is as coarse
+    std::vector<QImage> _levels;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QString>
+#include <QTimer>
+
+// Reports files that appear in watched directories once they are
+// completely written. On Linux a file is complete when its writer
+// closes it or it is moved into place; files that turn up without a
+// local writer (some network shares) are caught by the size holding
+// still for a tick. Elsewhere only new files are seen, through
+// QFileSystemWatcher, and the size is all there is to go on.
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderWatcher(QObject* parent = nullptr);
+    ~FolderWatcher();
+
+    bool watch(const QString& absoluteDirPath);
+
+signals:
+    void fileReady(QString absolutePath);
+
+private:
+#ifdef Q_OS_LINUX
+    void readEvents();
+#else
+    void dirChanged(const QString& absoluteDirPath);
+#endif
+    void checkPending();
+
+private:
+    static const int g_settleMs = 500;
+
+private:
+#ifdef Q_OS_LINUX
+    int _fd;
+    QSocketNotifier* _notifier;
+    QHash<int, QString> _dirs;
+
+    // Files a local writer has open; they're reported when it closes
+    // them, never by the size check, which a pause in writing would
+    // fool
+    QSet<QString> _writing;
+#else
+    QFileSystemWatcher _fsWatcher;
+    // The files in each watched dir, as of the last look
+    QHash<QString, QSet<QString>> _entries;
+#endif
+
+    // Files waiting for their size to settle, with their size at the
+    // last tick (-1 before the first)
+    QHash<QString, qint64> _pending;
+    QTimer _settleTimer;
+};
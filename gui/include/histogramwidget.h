@@ -1,6 +1,9 @@
 #pragma once
 
+#include <memory>
+
 #include <QImage>
+#include <QResizeEvent>
 #include <QWidget>
 
 class HistogramWidget : public QWidget
@@ -14,16 +17,39 @@ public:
     QSize sizeHint() const override;
     QSize minimumSizeHint() const override;
 
+    // prefixSums is from makePrefixSums() on the same data, so that
+    // showing an item is a pointer swap on the GUI thread
     void setHistogramData(bool isColor,
                           int numPoints,
-                          std::shared_ptr<const uint32_t[]> data);
+                          std::shared_ptr<const uint32_t[]> data,
+                          std::shared_ptr<const uint64_t[]> prefixSums);
+
+    // numPoints + 1 per channel; entry i is the sum of points [0, i).
+    // Slow for wide histograms, so made off the GUI thread.
+    static std::shared_ptr<const uint64_t[]> makePrefixSums(bool isColor,
+                                                            int numPoints,
+                                                            const uint32_t* data);
 
 protected:
     virtual void paintEvent(QPaintEvent* event) override;
+    virtual void resizeEvent(QResizeEvent* event) override;
+
+private:
+    // Sum of the histogram over [0, idx) of a channel, where idx can
+    // fall part way through a point
+    double sumTo(int chan,
+                 double idx) const;
+
+    // Rebin to w columns and draw them into a w x (h + 1) image
+    QImage rasterise(int w,
+                     int h) const;
 
 private:
     bool _isColor;
     int _numPoints;
     std::shared_ptr<const uint32_t[]> _data;
-    QImage* _histImage;
+    // See makePrefixSums()
+    std::shared_ptr<const uint64_t[]> _prefixSums;
+    // What was last painted; rebuilt on resize or new data
+    QImage _histImage;
 };
\ No newline at end of file
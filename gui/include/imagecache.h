@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QHash>
+#include <inttypes.h>
+#include <list>
+
+#include "imagestore.h"
+
+class ImageCache
+{
+public:
+    ImageCache(int64_t budgetBytes = g_defaultBudgetBytes);
+    ~ImageCache();
+
+    int64_t getBudgetBytes() const;
+    void setBudgetBytes(int64_t budgetBytes);
+
+    // Mark an item as most recently used. Only items that have been
+    // touched are ever released from, so touch each one as it loads.
+    void touch(ImageStore::Handle handle);
+    void forget(ImageStore::Handle handle);
+
+    // Count a request for an item as served from memory or not
+    void recordHit();
+    void recordMiss();
+
+    int getHits() const;
+    int getMisses() const;
+    int64_t getLastUsage() const;
+
+    // Drop the full histograms of all but the protected item, then
+    // release parts of the least recently used items until they fit
+    // in the budget. Display buffers go first (pyramid levels, and
+    // the frames of streamed items), then raw pixels, which take the
+    // display of a resident item with them, then histograms. The
+    // protected item is never released from. Takes time in the number
+    // of items touched, not the number stored.
+    void enforce(ImageStore& store,
+                 ImageStore::Handle protectedHandle);
+
+public:
+    static const int64_t g_defaultBudgetBytes;
+
+private:
+    enum EvictStage
+    {
+        ES_IMAGE,
+        ES_DISPLAY,
+        ES_HISTOGRAM
+    };
+
+private:
+    static int64_t release(ImageFileListItem& item,
+                           EvictStage stage);
+
+private:
+    int64_t _budgetBytes;
+    // Oldest first, with where each handle sits in it
+    std::list<ImageStore::Handle> _lru;
+    QHash<ImageStore::Handle, std::list<ImageStore::Handle>::iterator> _lruPos;
+    int _hits;
+    int _misses;
+    int64_t _lastUsage;
+};
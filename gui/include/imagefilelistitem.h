@@ -1,20 +1,45 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <QDataStream>
 #include <QImage>
+#include <QMetaType>
 #include <QString>
 
+#include "compacthistogram.h"
+#include "displayrenderer.h"
 #include "image.h"
 #include "pixstfparms.h"
 
+namespace ELS
+{
+    template <typename PixelT>
+    class PixStatistics;
+    template <typename PixelT>
+    class StatisticsVisitor;
+}
+
 class ImageFileListItem
 {
+public:
+    // Wall clock time spent in each stage of load(), in milliseconds
+    struct LoadTimings
+    {
+        qint64 decodeMs;
+        qint64 statsMs;
+        qint64 lutMs;
+        qint64 renderMs;
+    };
+
 public:
     ImageFileListItem();
     ImageFileListItem(QString absolutePath,
                       ELS::Image::FileType fileType = ELS::Image::FT_UNKNOWN,
                       bool isValidated = false);
+    // A validated item whose header has already been probed
+    ImageFileListItem(QString absolutePath,
+                      const ELS::Image::Info& info);
     ~ImageFileListItem();
 
     QString absolutePath() const;
@@ -29,15 +54,73 @@ public:
     QString getMedian() const;
     QString getMax() const;
     int getNumHistogramPoints() const;
+    // Expanded for the caller if the item holds it only compacted
     std::shared_ptr<const uint32_t[]> getHistogram() const;
+    // Null unless the item has its histogram in full; see
+    // HistogramWidget::makePrefixSums()
+    std::shared_ptr<const uint64_t[]> getHistogramPrefixSums() const;
+
+    // Renders the display on request; null until load()
+    std::shared_ptr<const DisplayRenderer> getRenderer() const;
+
+    QString getDateObs() const;
+    QString getExposure() const;
+    QString getFilter() const;
+    QString getObject() const;
+
+    LoadTimings getLoadTimings() const;
+
+    // Approximate bytes held by the item: raw pixels, histogram,
+    // LUTs and the display's whole-image buffers (pyramid levels, and
+    // the frame of a streamed image), whichever of them are resident
+    int64_t getMemoryUsage() const;
+    int64_t getImageMemoryUsage() const;
+    int64_t getDisplayMemoryUsage() const;
+    int64_t getHistogramMemoryUsage() const;
 
-    std::shared_ptr<const QImage> getQImage() const;
+    bool hasImage() const;
+    bool hasDisplay() const;
+    bool hasHistogram() const;
+    bool hasFullHistogram() const;
 
     void setValidated(bool isValidated);
     void setShowStretched(bool showStretched);
 
+    // Brings back whatever is missing (raw pixels, statistics and
+    // histogram, display buffer); a no-op for a fully loaded item
     void load();
 
+    // Take what a load() of a copy of this item brought back, keeping
+    // this item's stretch. If the stretch was toggled while the copy
+    // loaded, its render becomes the alternate and this item still
+    // needs a load() to be shown.
+    void adoptLoaded(const ImageFileListItem& loaded);
+
+    // Render the display with the other stretch too, so toggling the
+    // stretch is instant. Call it on a loaded item, off the GUI
+    // thread, then hand the result to adoptAlternate() on the item in
+    // the list.
+    void renderAlternate();
+    bool hasAlternate() const;
+    void adoptAlternate(const ImageFileListItem& rendered);
+
+    // Drop parts of a loaded item to save memory. The statistics
+    // strings survive; load() restores the rest on demand.
+    void releaseImage();
+    void releaseDisplay();
+    void releaseHistogram();
+
+    // Loaded items keep their histogram packed (see CompactHistogram);
+    // the one being shown has it in full as well, with its prefix
+    // sums. Packing and expanding take a while for wide histograms,
+    // so packHistogram() and expandHistogram() are called off the GUI
+    // thread, and adoptHistogram() takes the result. compactHistogram()
+    // then only drops the full form, unless it was never packed.
+    void packHistogram();
+    void expandHistogram();
+    void adoptHistogram(const ImageFileListItem& expanded);
+    void compactHistogram();
+
     void streamTo(QDataStream& out) const;
     void streamFrom(QDataStream& in);
 
@@ -48,20 +131,41 @@ public:
     bool operator<=(const ImageFileListItem& rhs) const;
     bool operator>=(const ImageFileListItem& rhs) const;
 
+public:
+    // FITS files with more pixel data than this are never held in
+    // memory; statistics and renders stream them from disk
+    static const int64_t g_streamThresholdBytes;
+    // The render of a streamed image is reduced by a power of 2 until
+    // it's no bigger than this
+    static const int64_t g_streamedFrameMaxBytes;
+
 private:
+    void readInfo(const char* filename);
+    void setInfo(const ELS::Image::Info& info);
+    void visitPixels(ELS::PixelVisitor* visitor);
     void calculateStatistics();
-    void calculateLUTs();
+    template <typename PixelT>
+    void refineStatistics(ELS::StatisticsVisitor<PixelT>* coarse,
+                          ELS::PixStatistics<PixelT>* statistics);
+    // The identity or stretch LUT, fetched from LutStore the first
+    // time it's asked for
+    std::shared_ptr<const uint8_t[]> getLUT(bool stretched);
+    std::shared_ptr<const DisplayRenderer> makeRenderer(std::shared_ptr<const uint8_t[]> lut);
 
 private:
     class ToQImageVisitor : public ELS::PixelVisitor
     {
     public:
+        // Each reduction x reduction block of pixels (a power of 2) is
+        // rendered as their mean. Reduced renders take the rows in
+        // order, so can't be cloned.
         ToQImageVisitor(ELS::PixSTFParms stfParms,
-                        uint8_t* lut,
-                        int lutPoints);
+                        const uint8_t* lut,
+                        int lutPoints,
+                        int reduction = 1);
         ~ToQImageVisitor();
 
-        std::shared_ptr<uint32_t[]> getImageData();
+        // Grayscale8 for grey images, RGB32 for colour
         std::shared_ptr<QImage> getImage();
 
     public:
@@ -121,28 +225,60 @@ private:
 
         virtual void done() override;
 
+        // Clones render into the original's buffer; their rows never
+        // overlap, so there's nothing to merge
+        virtual ELS::PixelVisitor* clone() const override;
+
+    private:
+        // Where row y renders to, and adding it into its block once
+        // it has
+        uint8_t* grayRow(int y);
+        uint32_t* rgbRow(int y);
+        void reduceRow(int y);
+
     private:
+        bool _isClone;
         int _width;
         int _height;
-        int _pixCount;
+        int64_t _pixCount;
+        bool _isGray;
         std::shared_ptr<uint32_t[]> _qiData;
+        std::shared_ptr<uint8_t[]> _grayData;
         int _stride;
         ELS::PixSTFParms _stfParms;
         std::shared_ptr<QImage> _qi;
-        uint8_t* _lut;
+        const uint8_t* _lut;
         int _lutPoints;
         int _gOffset;
         int _bOffset;
+        int _reduction;
+        int _reductionShift;
+        int _outWidth;
+        int _outHeight;
+        // One rendered row, and the block sums per output column and
+        // channel, when reducing
+        std::unique_ptr<uint8_t[]> _grayRow;
+        std::unique_ptr<uint32_t[]> _rgbRow;
+        std::vector<uint32_t> _blockSums;
     };
 
 private:
     QString _absolutePath;
     ELS::Image::FileType _fileType;
     bool _isValidated;
-    bool _isLoaded;
     bool _showStretched;
 
     std::shared_ptr<ELS::Image> _image;
+    bool _isStreamed;
+    bool _isColor;
+    ELS::SampleFormat _sampleFormat;
+    int _width;
+    int _height;
+    int64_t _pixelDataSize;
+    QString _dateObs;
+    QString _exposure;
+    QString _filter;
+    QString _object;
 
     ELS::PixSTFParms _stfParms;
     QString _min;
@@ -152,16 +288,24 @@ private:
     int _numHistogramPoints;
     int _gOffset;
     int _bOffset;
+    // The full form, when set, has its prefix sums with it
     std::shared_ptr<uint32_t[]> _histogram;
+    std::shared_ptr<const uint64_t[]> _histogramPrefixSums;
+    std::shared_ptr<const CompactHistogram> _compactHistogram;
 
-    uint8_t* _stfLUT;
-    uint8_t* _identityLUT;
-    uint8_t* _lutInUse;
+    // Shared with other items; see LutStore
+    std::shared_ptr<const uint8_t[]> _stfLUT;
+    std::shared_ptr<const uint8_t[]> _identityLUT;
 
-    std::shared_ptr<uint32_t[]> _qiData;
-    std::shared_ptr<QImage> _qi;
+    std::shared_ptr<const DisplayRenderer> _renderer;
+    // The display with the other stretch, when it's been made
+    std::shared_ptr<const DisplayRenderer> _altRenderer;
+
+    LoadTimings _loadTimings;
 };
 
+Q_DECLARE_METATYPE(ImageFileListItem)
+
 inline QDataStream& operator<<(QDataStream& out, const ImageFileListItem& item)
 {
     item.streamTo(out);
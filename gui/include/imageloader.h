@@ -0,0 +1,134 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QRunnable>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+#include "imagefilelistitem.h"
+
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageLoader(QObject* parent = nullptr);
+    ~ImageLoader();
+
+    // Queue a load of the given item on the worker pool. Requests
+    // for a path that is already being loaded are ignored, unless
+    // supersede is set (the file has been rewritten), when whatever
+    // is in flight for the path is dropped as it finishes. Returns
+    // true if a new load was queued. Higher priority loads are
+    // started first. The histogram comes back packed, and for loads
+    // at g_currentPriority in full as well, ready to be shown.
+    bool requestLoad(const ImageFileListItem& item,
+                     int priority = g_prefetchPriority,
+                     bool supersede = false);
+
+    // Queue the display with the other stretch for a loaded item,
+    // at the lowest priority; see ImageFileListItem::renderAlternate().
+    // Returns true if a new render was queued.
+    bool requestAlternate(const ImageFileListItem& item);
+
+    // Queue the expansion of a loaded item's packed histogram, for
+    // an item about to be shown; see ImageFileListItem::expandHistogram().
+    // Returns true if a new expansion was queued.
+    bool requestHistogram(const ImageFileListItem& item);
+
+    bool isPending(const QString& absolutePath) const;
+    int pendingCount() const;
+
+public:
+    static const int g_currentPriority = 1;
+    static const int g_prefetchPriority = 0;
+    // Decoding, statistics and rendering each spread across the
+    // shared ParallelFor workers, so two loads at a time are enough
+    // to keep the cores busy while one waits on the disk
+    static const int g_threadCount = 2;
+
+signals:
+    // Emitted from a worker thread; receivers in the GUI thread get
+    // these through a queued connection
+    void itemLoaded(ImageFileListItem item);
+    void itemFailed(QString absolutePath, QString errText);
+    // The item holds the other render; adopt it with
+    // ImageFileListItem::adoptAlternate()
+    void alternateRendered(ImageFileListItem item);
+    // The item holds the histogram in full; adopt it with
+    // ImageFileListItem::adoptHistogram()
+    void histogramExpanded(ImageFileListItem item);
+
+    // From the tasks, with the generation of the path they were
+    // started at; only results of the current generation are passed
+    // on as the signals above
+    void loadFinished(ImageFileListItem item, quint64 generation);
+    void loadFailed(QString absolutePath, QString errText, quint64 generation);
+    void alternateFinished(ImageFileListItem item, quint64 generation);
+    void histogramFinished(ImageFileListItem item, quint64 generation);
+
+private:
+    bool isCurrent(const QString& absolutePath, quint64 generation) const;
+
+private:
+    class LoadTask : public QRunnable
+    {
+    public:
+        LoadTask(ImageLoader* loader,
+                 const ImageFileListItem& item,
+                 quint64 generation,
+                 bool expandHistogram);
+        ~LoadTask();
+
+        virtual void run() override;
+
+    private:
+        ImageLoader* _loader;
+        ImageFileListItem _item;
+        quint64 _generation;
+        bool _expandHistogram;
+    };
+
+    class AlternateTask : public QRunnable
+    {
+    public:
+        AlternateTask(ImageLoader* loader,
+                      const ImageFileListItem& item,
+                      quint64 generation);
+        ~AlternateTask();
+
+        virtual void run() override;
+
+    private:
+        ImageLoader* _loader;
+        ImageFileListItem _item;
+        quint64 _generation;
+    };
+
+    class HistogramTask : public QRunnable
+    {
+    public:
+        HistogramTask(ImageLoader* loader,
+                      const ImageFileListItem& item,
+                      quint64 generation);
+        ~HistogramTask();
+
+        virtual void run() override;
+
+    private:
+        ImageLoader* _loader;
+        ImageFileListItem _item;
+        quint64 _generation;
+    };
+
+private:
+    QThreadPool _pool;
+    QSet<QString> _pending;
+    QSet<QString> _pendingAlternates;
+    QSet<QString> _pendingHistograms;
+    // Bumped each time a path's loads are superseded; paths never
+    // superseded are at 0 and aren't stored
+    QHash<QString, quint64> _generations;
+};
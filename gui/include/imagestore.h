@@ -0,0 +1,47 @@
+#pragma once
+
+#include <deque>
+
+#include <QHash>
+#include <QString>
+
+#include "imagefilelistitem.h"
+
+// Every file the window knows about, each held once. The list the user
+// steps through is a list of handles into it, so reordering, inserting
+// and passing items around moves small integers rather than items. A
+// handle refers to the same file for the life of the store. Paths map
+// to handles through a hash, so finding a file, e.g. to de-duplicate or
+// to put a loaded item back, takes constant time however long the list
+// gets.
+class ImageStore
+{
+public:
+    typedef qint32 Handle;
+
+public:
+    ImageStore();
+    ~ImageStore();
+
+    int size() const;
+
+    // The file's handle, or g_noHandle if it isn't stored
+    Handle find(const QString& absolutePath) const;
+
+    // Store an item under a new handle; g_noHandle if its path is
+    // stored already
+    Handle add(const ImageFileListItem& item);
+
+    // Valid until the store goes. Replace an item by assigning one
+    // with the same path to it.
+    ImageFileListItem& get(Handle handle);
+    const ImageFileListItem& get(Handle handle) const;
+
+public:
+    static const Handle g_noHandle = -1;
+
+private:
+    // A deque, so items stay put as it grows
+    std::deque<ImageFileListItem> _items;
+    QHash<QString, Handle> _handles;
+};
@@ -2,22 +2,40 @@
 
 #include <memory>
 
+#include <QImage>
+#include <QPainter>
 #include <QSizePolicy>
 #include <QString>
 #include <QWheelEvent>
 #include <QWidget>
 #include <fitsio.h>
 
+#include "displayrenderer.h"
 #include "image.h"
 #include "pixelvisitor.h"
 #include "pixstatistics.h"
 #include "pixstfparms.h"
 #include "pixutils.h"
+#include "tilecache.h"
 
 class ImageWidget : public QWidget
 {
     Q_OBJECT
 
+public:
+    // Time spent in paintEvent, in microseconds, since the last drag
+    // started. Scrolled frames are drag steps that moved what was on
+    // screen instead of repainting it; their paint covers only the
+    // exposed strips.
+    struct PaintTimings
+    {
+        qint64 frames;
+        qint64 scrolledFrames;
+        qint64 lastUs;
+        qint64 totalUs;
+        qint64 maxUs;
+    };
+
 public:
     explicit ImageWidget(QWidget* parent = nullptr);
     ~ImageWidget();
@@ -30,9 +48,10 @@ public:
     // const char* getFilename() const;
     // bool getStretched() const;
     float getZoom() const;
+    PaintTimings getPaintTimings() const;
 
 public slots:
-    void setImage(std::shared_ptr<const QImage> image);
+    void setImage(std::shared_ptr<const DisplayRenderer> renderer);
     // void setFile(const char* filename);
     // void showStretched();
     // void clearStretched();
@@ -68,6 +87,19 @@ protected:
     static float adjustZoom(float desiredZoom,
                             ZoomAdjustStrategy strategy = ZAS_CLOSEST);
 
+    // Work out _source, _target, the actual zoom and the reduction
+    // from the zoom and lock points
+    void layoutView();
+
+    // Paint the tiles covering _source that touch dirty, queueing the
+    // missing visible ones and the next ones over in the direction of
+    // the last pan
+    void paintTiles(QPainter& painter,
+                    const QRect& dirty);
+
+    // Where a tile lands in the widget
+    QRectF tileTargetRect(const TileCache::TileKey& key) const;
+
     // private:
     //     void calculateStfLUT();
 
@@ -75,7 +107,12 @@ private:
     QSizePolicy _sizePolicy;
     char _filename[500];
     // ELS::Image* _image;
-    std::shared_ptr<const QImage> _image;
+    std::shared_ptr<const DisplayRenderer> _renderer;
+    TileCache _tiles;
+    // Where _source was at the last paint, to tell the pan direction
+    QRect _lastSource;
+    int _reduction;
+    PaintTimings _paintTimings;
     // std::shared_ptr<uint32_t[]> _cacheImageData;
     // bool _showStretched;
     float _zoom;
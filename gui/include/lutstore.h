@@ -0,0 +1,54 @@
+#pragma once
+
+#include <inttypes.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "pixstfparms.h"
+
+// The display LUTs items render through, shared between them. An
+// identity LUT depends only on the histogram resolution and channel
+// count, so there's one of each for the life of the process. A
+// stretch LUT depends on the stretch parameters too; frames of one
+// sequence often come out with the same ones, and share a table for
+// as long as any of them holds it. Colour LUTs are three tables of
+// numPoints, one per channel. Safe to call from any thread.
+class LutStore
+{
+public:
+    static std::shared_ptr<const uint8_t[]> getIdentity(int numPoints,
+                                                        bool isColor);
+    static std::shared_ptr<const uint8_t[]> getStretch(int numPoints,
+                                                       bool isColor,
+                                                       const ELS::PixSTFParms& stfParms);
+
+private:
+    struct IdentityEntry
+    {
+        int numPoints;
+        bool isColor;
+        std::shared_ptr<const uint8_t[]> lut;
+    };
+
+    struct StretchEntry
+    {
+        int numPoints;
+        bool isColor;
+        ELS::PixSTFParms stfParms;
+        std::weak_ptr<const uint8_t[]> lut;
+    };
+
+private:
+    static std::shared_ptr<const uint8_t[]> buildStretch(int numPoints,
+                                                         bool isColor,
+                                                         const ELS::PixSTFParms& stfParms);
+
+private:
+    // Bins per unit of work when building a stretch LUT
+    static const int g_stretchBandPoints;
+
+    static std::mutex g_mutex;
+    static std::vector<IdentityEntry> g_identities;
+    static std::vector<StretchEntry> g_stretches;
+};
@@ -1,17 +1,26 @@
 #pragma once
 
+#include <QDateTime>
+#include <QDir>
 #include <QFileInfo>
+#include <QHash>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QMainWindow>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QTcpServer>
 #include <QVBoxLayout>
 
+#include "folderwatcher.h"
+#include "imagecache.h"
 #include "imagefilelistitem.h"
+#include "imageloader.h"
+#include "imagestore.h"
 #include "imagewidget.h"
 #include "histogramwidget.h"
 #include "pixstatistics.h"
+#include "prefetchpolicy.h"
 #include "pixstfparms.h"
 
 QT_BEGIN_NAMESPACE
@@ -26,11 +35,22 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
+    // fileOrder holds a sort key per item; later items are inserted
+    // among them by key. Empty means the list is already in order.
+    // Items after the first with the same path are dropped.
     MainWindow(QTcpServer& server,
-               QList<ImageFileListItem> fileList,
+               const QList<ImageFileListItem>& items,
+               QList<qint64> fileOrder = QList<qint64>(),
                QWidget* parent = nullptr);
     ~MainWindow();
 
+    void addScannedItem(qint64 order, ImageFileListItem item);
+
+    // Add files to the list as they finish landing in these dirs,
+    // optionally jumping to each new one
+    void watchDirs(const QList<QDir>& dirs,
+                   bool followNewest);
+
 private:
     // void fitsFileChanged(const char* filename);
     // void fitsFileFailed(const char* filename,
@@ -50,19 +70,54 @@ private:
     void readyRead();
     void disconnected();
 
+    void watchedFileReady(QString absolutePath);
+
+    void itemLoaded(ImageFileListItem item);
+    void itemFailed(QString absolutePath, QString errText);
+    void alternateRendered(ImageFileListItem item);
+    void histogramExpanded(ImageFileListItem item);
+
+    ImageFileListItem& itemAt(int idx);
+    // Whether the last load of the file failed and it hasn't been
+    // modified since
+    bool hasFailed(const QString& absolutePath);
+
     void syncFileIdx();
+    void showCurrentItem();
+    void prefetch();
     void syncFileCount();
     void syncStretch();
 
     // void addFilesToList(QList<QString> absoluteFilePaths);
 
+private:
+    // Order keys for files that arrive over the socket; above any
+    // key DirScanner hands out
+    static const qint64 g_appendOrderBase = Q_INT64_C(1) << 62;
+
 private:
     QTcpServer& server;
     QList<QTcpSocket*> clients;
-    QList<ImageFileListItem> fileList;
+    ImageStore imageStore;
+    // What the user steps through, as handles into imageStore
+    QList<ImageStore::Handle> fileList;
+    QList<qint64> fileOrder;
+    qint64 nextAppendOrder;
+    ImageLoader loader;
+    FolderWatcher folderWatcher;
+    bool followNewest;
+    PrefetchPolicy prefetchPolicy;
+    ImageCache imageCache;
+    // Modification times of files whose load failed, so prefetch()
+    // doesn't queue them again on every step; a rewrite clears them
+    QHash<QString, QDateTime> failedLoads;
     QString filename;
     int currentFileIdx;
     bool showingStretched;
+    // Render the current item with the other stretch in the background
+    // so the toggle is instant; off (FAK_STRETCH_BOTH=0) to save the
+    // memory, which leaves each toggle to a background re-render
+    bool renderBothStretches;
     QWidget mainPane;
     QVBoxLayout layout;
     ImageWidget imageWidget;
@@ -83,5 +138,6 @@ private:
     QPushButton prevBtn;
     QPushButton nextBtn;
     QLabel fileListPosLabel;
+    QProgressBar loadingBar;
     // ELS::PixSTFParms stfParms;
 };
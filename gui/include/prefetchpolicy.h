@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QList>
+#include <inttypes.h>
+
+class PrefetchPolicy
+{
+public:
+    PrefetchPolicy(int ahead = g_defaultAhead,
+                   int behind = g_defaultBehind,
+                   int64_t budgetBytes = g_defaultBudgetBytes);
+    ~PrefetchPolicy();
+
+    int getAhead() const;
+    int getBehind() const;
+    int64_t getBudgetBytes() const;
+    int getDirection() const;
+
+    void setAhead(int ahead);
+    void setBehind(int behind);
+    void setBudgetBytes(int64_t budgetBytes);
+
+    // Record a navigation step so prefetching follows the direction
+    // the user is moving in
+    void stepped(int fromIdx, int toIdx);
+
+    // Indexes worth loading around currentIdx, most wanted first.
+    // "Ahead" is in the direction of the last step.
+    QList<int> getCandidates(int currentIdx,
+                             int listSize) const;
+
+public:
+    static const int g_defaultAhead;
+    static const int g_defaultBehind;
+    static const int64_t g_defaultBudgetBytes;
+
+private:
+    int _ahead;
+    int _behind;
+    int64_t _budgetBytes;
+    int _direction;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QRect>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+
+#include "displayrenderer.h"
+
+// Fixed-size pieces of what ImageWidget shows, rendered on a worker
+// pool as they're asked for and kept up to a fixed count, least
+// recently used out first. A tile is keyed by renderer, which is one
+// image at one stretch, and by reduction, so going back to an image,
+// stretch or zoom level reuses what was rendered for it.
+class TileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct TileKey
+    {
+        quint64 rendererId;
+        int reduction;
+        int tileX;
+        int tileY;
+
+        bool operator==(const TileKey& other) const;
+    };
+
+public:
+    explicit TileCache(QObject* parent = nullptr);
+    ~TileCache();
+
+    // Requests come in batches, one per paint. Tiles queued by an
+    // earlier batch that the latest one didn't ask for again are
+    // dropped before they render, so a fast pan doesn't leave the
+    // pool busy with tiles that have scrolled away.
+    void beginRequests();
+    void endRequests();
+
+    // Queue the tile; nothing happens if it's cached or queued
+    // already. Higher priority tiles are started first.
+    void request(std::shared_ptr<const DisplayRenderer> renderer,
+                 const TileKey& key,
+                 int priority);
+
+    // The tile, or a null image if it isn't rendered yet
+    QImage find(const TileKey& key);
+
+    // The image pixels a tile covers, before clipping to the image
+    static QRect tileSource(const TileKey& key);
+
+public:
+    // In display pixels, i.e. after reduction
+    static const int g_tileSize = 256;
+    // 96 MB of ARGB32; a 4K viewport at 1:1 needs about 150
+    static const int g_maxTiles = 384;
+    static const int g_visiblePriority = 1;
+    static const int g_prefetchPriority = 0;
+    // Each render spreads its rows across the shared ParallelFor
+    // workers, so a couple of tasks at a time keep every core busy
+    static const int g_threadCount = 2;
+
+signals:
+    // Emitted on the thread this object lives in when a tile it was
+    // asked for arrives, or needs asking for again
+    void tileReady(quint64 rendererId,
+                   int reduction,
+                   int tileX,
+                   int tileY);
+
+    // Emitted from worker threads; a null tile means it was dropped
+    void tileRendered(quint64 rendererId,
+                      int reduction,
+                      int tileX,
+                      int tileY,
+                      QImage tile);
+
+private:
+    void tileFinished(const TileKey& key,
+                      const QImage& tile);
+    bool isWanted(const TileKey& key);
+
+private:
+    class RenderTask : public QRunnable
+    {
+    public:
+        RenderTask(TileCache* cache,
+                   std::shared_ptr<const DisplayRenderer> renderer,
+                   const TileKey& key);
+        ~RenderTask();
+
+        virtual void run() override;
+
+    private:
+        TileCache* _cache;
+        std::shared_ptr<const DisplayRenderer> _renderer;
+        TileKey _key;
+    };
+
+    struct Tile
+    {
+        QImage image;
+        qint64 lastUse;
+    };
+
+private:
+    QThreadPool _pool;
+    QHash<TileKey, Tile> _tiles;
+    QSet<TileKey> _pending;
+    qint64 _useClock;
+
+    // Everything the latest batch asked for; read by the workers
+    QMutex _wantedMutex;
+    QSet<TileKey> _wanted;
+    QSet<TileKey> _batch;
+};
+
+uint qHash(const TileCache::TileKey& key,
+           uint seed = 0);
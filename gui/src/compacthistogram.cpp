@@ -0,0 +1,104 @@
+#include "compacthistogram.h"
+
+CompactHistogram::CompactHistogram(const uint32_t* data,
+                                   int totalPoints)
+    : _totalPoints(totalPoints),
+      _packed()
+{
+    int i = 0;
+    while (i < _totalPoints)
+    {
+        int gap = 0;
+        while ((i + gap < _totalPoints) && (data[i + gap] == 0))
+        {
+            gap++;
+        }
+        i += gap;
+        if (i == _totalPoints)
+        {
+            break;
+        }
+
+        int length = 0;
+        while ((i + length < _totalPoints) && (data[i + length] != 0))
+        {
+            length++;
+        }
+
+        put(gap);
+        put(length);
+        for (int j = 0; j < length; j++)
+        {
+            put(data[i + j]);
+        }
+        i += length;
+    }
+
+    _packed.shrink_to_fit();
+}
+
+CompactHistogram::~CompactHistogram()
+{
+}
+
+int64_t CompactHistogram::getMemoryUsage() const
+{
+    return sizeof(*this) + (int64_t)_packed.capacity();
+}
+
+std::shared_ptr<uint32_t[]> CompactHistogram::expand() const
+{
+    std::shared_ptr<uint32_t[]> data(new uint32_t[_totalPoints]);
+
+    const uint8_t* next = _packed.data();
+    const uint8_t* end = next + _packed.size();
+    int i = 0;
+    while (next < end)
+    {
+        uint32_t gap = get(&next);
+        for (uint32_t j = 0; j < gap; j++)
+        {
+            data[i++] = 0;
+        }
+
+        uint32_t length = get(&next);
+        for (uint32_t j = 0; j < length; j++)
+        {
+            data[i++] = get(&next);
+        }
+    }
+
+    while (i < _totalPoints)
+    {
+        data[i++] = 0;
+    }
+
+    return data;
+}
+
+void CompactHistogram::put(uint32_t val)
+{
+    // Seven bits at a time, low first; the top bit flags another byte
+    while (val >= 0x80)
+    {
+        _packed.push_back((uint8_t)(val | 0x80));
+        val >>= 7;
+    }
+    _packed.push_back((uint8_t)val);
+}
+
+/* static */
+uint32_t CompactHistogram::get(const uint8_t** next)
+{
+    uint32_t val = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = *(*next)++;
+        val |= (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while ((byte & 0x80) != 0);
+
+    return val;
+}
@@ -0,0 +1,153 @@
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+
+#include "dirscanner.h"
+#include "image.h"
+
+DirScanner::DirScanner(QObject* parent /* = nullptr */)
+    : QObject(parent),
+      _pool(),
+      _seenMutex(),
+      _seen(),
+      _outstanding(0)
+{
+    qRegisterMetaType<ImageFileListItem>("ImageFileListItem");
+
+    _pool.setMaxThreadCount(std::min(g_maxThreads,
+                                     std::max(4, QThread::idealThreadCount() * 2)));
+
+    // Results are relayed through this thread so anything connected
+    // to fileFound() before the event loop gets to them sees them all
+    QObject::connect(this, &DirScanner::fileProbed,
+                     this, &DirScanner::fileFound,
+                     Qt::QueuedConnection);
+    QObject::connect(this, &DirScanner::scanDrained,
+                     this, &DirScanner::finished,
+                     Qt::QueuedConnection);
+}
+
+DirScanner::~DirScanner()
+{
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void DirScanner::scan(const QList<QString>& absoluteFilePaths,
+                      const QList<QDir>& dirs)
+{
+    // Hold a count for ourselves so the scan can't drain while the
+    // tasks are still being queued
+    _outstanding++;
+
+    // Command line files come first, then each directory's files in
+    // listing order
+    for (int i = 0; i < absoluteFilePaths.size(); i++)
+    {
+        if (claimPath(absoluteFilePaths[i]))
+        {
+            startTask(new ProbeTask(this, absoluteFilePaths[i], i));
+        }
+    }
+
+    for (int i = 0; i < dirs.size(); i++)
+    {
+        startTask(new ListTask(this, dirs[i], i));
+    }
+
+    taskFinished();
+}
+
+void DirScanner::startTask(QRunnable* task)
+{
+    _outstanding++;
+    _pool.start(task);
+}
+
+void DirScanner::taskFinished()
+{
+    if (--_outstanding == 0)
+    {
+        emit scanDrained();
+    }
+}
+
+bool DirScanner::claimPath(const QString& absolutePath)
+{
+    QMutexLocker lock(&_seenMutex);
+
+    if (_seen.contains(absolutePath))
+    {
+        return false;
+    }
+
+    _seen.insert(absolutePath);
+    return true;
+}
+
+DirScanner::ListTask::ListTask(DirScanner* scanner,
+                               const QDir& dir,
+                               int dirIdx)
+    : QRunnable(),
+      _scanner(scanner),
+      _dir(dir),
+      _dirIdx(dirIdx)
+{
+    setAutoDelete(true);
+}
+
+DirScanner::ListTask::~ListTask()
+{
+}
+
+void DirScanner::ListTask::run()
+{
+    QList<QFileInfo> dirFiles = _dir.entryInfoList(QDir::Files);
+    for (int i = 0; i < dirFiles.size(); i++)
+    {
+        QString absolutePath = dirFiles[i].absoluteFilePath();
+        if (_scanner->claimPath(absolutePath))
+        {
+            qint64 order = ((qint64)(_dirIdx + 1) << 32) | i;
+            _scanner->startTask(new ProbeTask(_scanner, absolutePath, order));
+        }
+    }
+
+    _scanner->taskFinished();
+}
+
+DirScanner::ProbeTask::ProbeTask(DirScanner* scanner,
+                                 const QString& absolutePath,
+                                 qint64 order)
+    : QRunnable(),
+      _scanner(scanner),
+      _absolutePath(absolutePath),
+      _order(order)
+{
+    setAutoDelete(true);
+}
+
+DirScanner::ProbeTask::~ProbeTask()
+{
+}
+
+void DirScanner::ProbeTask::run()
+{
+    char error[2048];
+
+    QByteArray ba = _absolutePath.toLocal8Bit();
+    ELS::Image::Info info;
+    ELS::Image::FileType fileType = ELS::Image::probe(ba.data(), &info, error);
+    if (fileType != ELS::Image::FT_UNKNOWN)
+    {
+        emit _scanner->fileProbed(_order, ImageFileListItem(_absolutePath, info));
+    }
+    else
+    {
+        fprintf(stderr, "%s\n", error);
+        fflush(stderr);
+    }
+
+    _scanner->taskFinished();
+}
@@ -0,0 +1,481 @@
+#include <algorithm>
+#include <atomic>
+
+#include "parallelfor.h"
+#include "pixkernels.h"
+#include "displayrenderer.h"
+
+std::atomic<quint64> DisplayRenderer::g_nextId(1);
+const int DisplayRenderer::g_pyramidLevels = 3;
+const int DisplayRenderer::g_pyramidBandRows = 32;
+const int DisplayRenderer::g_renderBandRows = 16;
+
+// Hand bands of rows out to the shared workers (see ParallelFor)
+template <typename WorkT>
+static void forEachBand(int rows,
+                        int bandRows,
+                        WorkT work)
+{
+    const int bandCount = (rows + bandRows - 1) / bandRows;
+    ELS::ParallelFor::run(bandCount, [&](int /* slot */, int64_t band)
+                          {
+                              int firstRow = (int)band * bandRows;
+                              work(firstRow, std::min(firstRow + bandRows, rows));
+                              return true;
+                          });
+}
+
+template <typename PixelT>
+static void sampleRowsOf(const QImage& src,
+                         int left,
+                         int top,
+                         int step,
+                         int scaleShift,
+                         QImage* out)
+{
+    for (int y = 0; y < out->height(); y++)
+    {
+        const PixelT* srcRow = (const PixelT*)src.constScanLine((top + y * step) >> scaleShift);
+        PixelT* dst = (PixelT*)out->scanLine(y);
+        for (int x = 0, srcX = left; x < out->width(); x++, srcX += step)
+        {
+            dst[x] = srcRow[srcX >> scaleShift];
+        }
+    }
+}
+
+// Every step'th pixel from (left, top), in image pixels, enough to
+// fill out, which has src's format. src is the image reduced by
+// 2^scaleShift.
+static void sampleRows(const QImage& src,
+                       int left,
+                       int top,
+                       int step,
+                       int scaleShift,
+                       QImage* out)
+{
+    if (src.format() == QImage::Format_Grayscale8)
+    {
+        sampleRowsOf<uint8_t>(src, left, top, step, scaleShift, out);
+    }
+    else
+    {
+        sampleRowsOf<uint32_t>(src, left, top, step, scaleShift, out);
+    }
+}
+
+static int log2Of(int scale)
+{
+    int shift = 0;
+    while ((1 << (shift + 1)) <= scale)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+DisplayRenderer::DisplayRenderer(std::shared_ptr<const ELS::Image> image,
+                                 std::shared_ptr<const uint8_t[]> lut,
+                                 int lutPoints,
+                                 bool lutIsIdentity /* = false */)
+    : _id(g_nextId++),
+      _image(image),
+      _lut(lut),
+      _lutPoints(lutPoints),
+      _format(image->isColor() ? QImage::Format_RGB32 : QImage::Format_Grayscale8),
+      _width(image->getWidth()),
+      _height(image->getHeight()),
+      _frame(),
+      _frameScale(1),
+      _levels()
+{
+    // Unstretched 8-bit grey samples are already what we'd render, so
+    // show them where they lie
+    const uint8_t* grayBytes = lutIsIdentity ? _image->getGrayBytes() : 0;
+    if (grayBytes != 0)
+    {
+        _frame.reset(new QImage(grayBytes,
+                                _image->getWidth(),
+                                _image->getHeight(),
+                                _image->getWidth(),
+                                QImage::Format_Grayscale8));
+    }
+}
+
+DisplayRenderer::DisplayRenderer(std::shared_ptr<const QImage> frame,
+                                 int width,
+                                 int height,
+                                 int frameScale /* = 1 */)
+    : _id(g_nextId++),
+      _image(),
+      _lut(),
+      _lutPoints(0),
+      _format(frame->format() == QImage::Format_Grayscale8 ? QImage::Format_Grayscale8 : QImage::Format_RGB32),
+      _width(width),
+      _height(height),
+      _frame(frame),
+      _frameScale(frameScale),
+      _levels()
+{
+}
+
+DisplayRenderer::~DisplayRenderer()
+{
+}
+
+quint64 DisplayRenderer::getId() const
+{
+    return _id;
+}
+
+int DisplayRenderer::width() const
+{
+    return _width;
+}
+
+int DisplayRenderer::height() const
+{
+    return _height;
+}
+
+int64_t DisplayRenderer::getMemoryUsage() const
+{
+    // A frame over the image's own samples costs nothing extra
+    int64_t bytes = (_image == 0) ? (int64_t)_frame->bytesPerLine() * _frame->height() : 0;
+    for (size_t i = 0; i < _levels.size(); i++)
+    {
+        bytes += (int64_t)_levels[i].bytesPerLine() * _levels[i].height();
+    }
+
+    return bytes;
+}
+
+void DisplayRenderer::buildPyramid()
+{
+    _levels.clear();
+
+    int levelW = width();
+    int levelH = height();
+    for (int level = 0; level < g_pyramidLevels; level++)
+    {
+        levelW = (levelW + 1) / 2;
+        levelH = (levelH + 1) / 2;
+
+        // The frame stands in for levels no finer than itself
+        if ((2 << level) <= _frameScale)
+        {
+            _levels.push_back(QImage());
+            continue;
+        }
+
+        QImage dst(levelW, levelH, _format);
+
+        // scanLine() isn't safe to call on one image from several
+        // threads, so the workers get the raw rows
+        uchar* dstBits = dst.bits();
+        const int dstBytesPerLine = dst.bytesPerLine();
+
+        if ((level > 0) && !_levels[level - 1].isNull())
+        {
+            const QImage& src = _levels[level - 1];
+            forEachBand(levelH, g_pyramidBandRows, [&](int firstRow, int lastRow)
+                        {
+                            halveRows(src, 0, dstBits, dstBytesPerLine, firstRow, lastRow);
+                        });
+        }
+        else if (_frame != 0)
+        {
+            const QImage& src = *_frame;
+            forEachBand(levelH, g_pyramidBandRows, [&](int firstRow, int lastRow)
+                        {
+                            halveRows(src, 0, dstBits, dstBytesPerLine, firstRow, lastRow);
+                        });
+        }
+        else
+        {
+            // The full-resolution render only ever exists a band at a
+            // time
+            forEachBand(levelH, g_pyramidBandRows, [&](int firstRow, int lastRow)
+                        {
+                            QImage strip = render(QRect(0, firstRow * 2, width(), (lastRow - firstRow) * 2), 1);
+                            halveRows(strip, firstRow * 2, dstBits, dstBytesPerLine, firstRow, lastRow);
+                        });
+        }
+
+        _levels.push_back(dst);
+    }
+}
+
+QImage DisplayRenderer::render(const QRect& source,
+                               int reduction) const
+{
+    QRect clipped = source & QRect(0, 0, width(), height());
+    if (clipped.isEmpty())
+    {
+        return QImage();
+    }
+
+    reduction = std::max(reduction, 1);
+    QImage out((clipped.width() + reduction - 1) / reduction,
+               (clipped.height() + reduction - 1) / reduction,
+               _format);
+
+    int level = (int)_levels.size() - 1;
+    while ((level >= 0) && (((reduction % (2 << level)) != 0) || _levels[level].isNull()))
+    {
+        level--;
+    }
+
+    if (level >= 0)
+    {
+        sampleRows(_levels[level], clipped.left(), clipped.top(), reduction, level + 1, &out);
+    }
+    else if (_frame != 0)
+    {
+        sampleRows(*_frame, clipped.left(), clipped.top(), reduction, log2Of(_frameScale), &out);
+    }
+    else
+    {
+        // Bands of output rows are disjoint, so each gets a visitor
+        // of its own writing straight into out
+        uchar* outBits = out.bits();
+        const int outBytesPerLine = out.bytesPerLine();
+        forEachBand(out.height(), g_renderBandRows, [&](int firstRow, int lastRow)
+                    {
+                        RegionVisitor visitor(_lut.get(), _lutPoints, clipped, reduction,
+                                              outBits, outBytesPerLine, out.width());
+                        _image->visitPixels(&visitor,
+                                            clipped.top() + firstRow * reduction,
+                                            std::min(clipped.top() + lastRow * reduction, clipped.bottom() + 1),
+                                            reduction);
+                    });
+    }
+
+    return out;
+}
+
+/* static */
+void DisplayRenderer::halveRows(const QImage& src,
+                                int srcTop,
+                                uchar* dstBits,
+                                int dstBytesPerLine,
+                                int firstRow,
+                                int lastRow)
+{
+    // An odd last row or column is averaged with itself
+    const int srcW = src.width();
+    const int pairs = srcW / 2;
+    const bool isGray = (src.format() == QImage::Format_Grayscale8);
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        int y0 = y * 2 - srcTop;
+        int y1 = std::min(y0 + 1, src.height() - 1);
+
+        if (isGray)
+        {
+            const uint8_t* row0 = src.constScanLine(y0);
+            const uint8_t* row1 = src.constScanLine(y1);
+            uint8_t* out = dstBits + (int64_t)y * dstBytesPerLine;
+
+            ELS::PixKernels::halveGray(row0, row1, pairs, out);
+            if ((srcW & 1) != 0)
+            {
+                out[pairs] = (uint8_t)((row0[srcW - 1] + row1[srcW - 1] + 1) / 2);
+            }
+            continue;
+        }
+
+        const uint32_t* row0 = (const uint32_t*)src.constScanLine(y0);
+        const uint32_t* row1 = (const uint32_t*)src.constScanLine(y1);
+        uint32_t* out = (uint32_t*)(dstBits + (int64_t)y * dstBytesPerLine);
+
+        ELS::PixKernels::halveArgb(row0, row1, pairs, out);
+        if ((srcW & 1) != 0)
+        {
+            uint32_t last0[2] = {row0[srcW - 1], row0[srcW - 1]};
+            uint32_t last1[2] = {row1[srcW - 1], row1[srcW - 1]};
+            ELS::PixKernels::halveArgb(last0, last1, 1, &out[pairs]);
+        }
+    }
+}
+
+DisplayRenderer::RegionVisitor::RegionVisitor(const uint8_t* lut,
+                                              int lutPoints,
+                                              const QRect& source,
+                                              int reduction,
+                                              uchar* outBits,
+                                              int outBytesPerLine,
+                                              int outWidth)
+    : _lut(lut),
+      _lutPoints(lutPoints),
+      _source(source),
+      _reduction(reduction),
+      _stride(0),
+      _outBits(outBits),
+      _outBytesPerLine(outBytesPerLine),
+      _outWidth(outWidth)
+{
+}
+
+DisplayRenderer::RegionVisitor::~RegionVisitor()
+{
+}
+
+void DisplayRenderer::RegionVisitor::pixelFormat(ELS::PixelFormat pf)
+{
+    (void)pf;
+}
+
+void DisplayRenderer::RegionVisitor::dimensions(int width,
+                                                int height)
+{
+    (void)width;
+    (void)height;
+}
+
+void DisplayRenderer::RegionVisitor::rowInfo(int stride)
+{
+    _stride = stride;
+}
+
+template <typename PixelT>
+void DisplayRenderer::RegionVisitor::gray(int y,
+                                          const PixelT* k)
+{
+    int64_t first = (int64_t)_source.left() * _stride;
+    ELS::PixKernels::renderGray(k + first,
+                                _outWidth,
+                                _stride * _reduction,
+                                _lut,
+                                _outBits + (int64_t)((y - _source.top()) / _reduction) * _outBytesPerLine);
+}
+
+template <typename PixelT>
+void DisplayRenderer::RegionVisitor::rgb(int y,
+                                         const PixelT* r,
+                                         const PixelT* g,
+                                         const PixelT* b)
+{
+    int64_t first = (int64_t)_source.left() * _stride;
+    ELS::PixKernels::renderRgb(r + first, g + first, b + first,
+                               _outWidth,
+                               _stride * _reduction,
+                               _lut, &_lut[_lutPoints], &_lut[_lutPoints * 2],
+                               (uint32_t*)(_outBits + (int64_t)((y - _source.top()) / _reduction) * _outBytesPerLine));
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const int8_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const int16_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const int32_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const uint8_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const uint16_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const uint32_t* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const float* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowGray(int y,
+                                             const double* k)
+{
+    gray(y, k);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const int8_t* r,
+                                            const int8_t* g,
+                                            const int8_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const int16_t* r,
+                                            const int16_t* g,
+                                            const int16_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const int32_t* r,
+                                            const int32_t* g,
+                                            const int32_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const uint8_t* r,
+                                            const uint8_t* g,
+                                            const uint8_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const uint16_t* r,
+                                            const uint16_t* g,
+                                            const uint16_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const uint32_t* r,
+                                            const uint32_t* g,
+                                            const uint32_t* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const float* r,
+                                            const float* g,
+                                            const float* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::rowRgb(int y,
+                                            const double* r,
+                                            const double* g,
+                                            const double* b)
+{
+    rgb(y, r, g, b);
+}
+
+void DisplayRenderer::RegionVisitor::done()
+{
+}
@@ -0,0 +1,211 @@
+#include <QDir>
+#include <QFileInfo>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "folderwatcher.h"
+
+FolderWatcher::FolderWatcher(QObject* parent /* = nullptr */)
+    : QObject(parent),
+#ifdef Q_OS_LINUX
+      _fd(-1),
+      _notifier(0),
+      _dirs(),
+      _writing(),
+#else
+      _fsWatcher(),
+      _entries(),
+#endif
+      _pending(),
+      _settleTimer()
+{
+    _settleTimer.setInterval(g_settleMs);
+    QObject::connect(&_settleTimer, &QTimer::timeout,
+                     this, &FolderWatcher::checkPending);
+
+#ifndef Q_OS_LINUX
+    QObject::connect(&_fsWatcher, &QFileSystemWatcher::directoryChanged,
+                     this, &FolderWatcher::dirChanged);
+#endif
+}
+
+FolderWatcher::~FolderWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+#endif
+}
+
+#ifdef Q_OS_LINUX
+
+bool FolderWatcher::watch(const QString& absoluteDirPath)
+{
+    if (_fd < 0)
+    {
+        _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_fd < 0)
+        {
+            fprintf(stderr, "Could not start watching folders: %s\n", strerror(errno));
+            fflush(stderr);
+            return false;
+        }
+
+        _notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
+        QObject::connect(_notifier, &QSocketNotifier::activated,
+                         this, &FolderWatcher::readEvents);
+    }
+
+    QByteArray ba = absoluteDirPath.toLocal8Bit();
+    int wd = inotify_add_watch(_fd,
+                               ba.data(),
+                               IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+    {
+        fprintf(stderr, "Could not watch '%s': %s\n", ba.data(), strerror(errno));
+        fflush(stderr);
+        return false;
+    }
+
+    _dirs.insert(wd, absoluteDirPath);
+
+    printf("Watching %s\n", ba.data());
+    fflush(stdout);
+
+    return true;
+}
+
+void FolderWatcher::readEvents()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        ssize_t len = read(_fd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            break;
+        }
+
+        for (char* p = buf; p < buf + len;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if ((event->len == 0) || (event->mask & IN_ISDIR) || !_dirs.contains(event->wd))
+            {
+                continue;
+            }
+
+            QString absolutePath = _dirs[event->wd] + "/" + QString::fromLocal8Bit(event->name);
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            {
+                _pending.remove(absolutePath);
+                _writing.remove(absolutePath);
+                emit fileReady(absolutePath);
+            }
+            else if (event->mask & IN_MODIFY)
+            {
+                // A local writer, which will close it
+                _pending.remove(absolutePath);
+                _writing.insert(absolutePath);
+            }
+            else if (!_writing.contains(absolutePath) && !_pending.contains(absolutePath))
+            {
+                _pending.insert(absolutePath, -1);
+            }
+        }
+    }
+
+    if (!_pending.isEmpty() && !_settleTimer.isActive())
+    {
+        _settleTimer.start();
+    }
+}
+
+#else
+
+bool FolderWatcher::watch(const QString& absoluteDirPath)
+{
+    QByteArray ba = absoluteDirPath.toLocal8Bit();
+    if (!_fsWatcher.addPath(absoluteDirPath))
+    {
+        fprintf(stderr, "Could not watch '%s'\n", ba.data());
+        fflush(stderr);
+        return false;
+    }
+
+    // Only what arrives from now on is new
+    QStringList names = QDir(absoluteDirPath).entryList(QDir::Files);
+    _entries.insert(absoluteDirPath, QSet<QString>(names.begin(), names.end()));
+
+    printf("Watching %s\n", ba.data());
+    fflush(stdout);
+
+    return true;
+}
+
+void FolderWatcher::dirChanged(const QString& absoluteDirPath)
+{
+    QStringList names = QDir(absoluteDirPath).entryList(QDir::Files);
+    QSet<QString>& known = _entries[absoluteDirPath];
+
+    QStringList::const_iterator i;
+    for (i = names.constBegin(); i != names.constEnd(); ++i)
+    {
+        if (!known.contains(*i))
+        {
+            _pending.insert(absoluteDirPath + "/" + *i, -1);
+        }
+    }
+
+    // Forget deleted files, so one put back under the same name is new
+    known = QSet<QString>(names.begin(), names.end());
+
+    if (!_pending.isEmpty() && !_settleTimer.isActive())
+    {
+        _settleTimer.start();
+    }
+}
+
+#endif
+
+void FolderWatcher::checkPending()
+{
+    QHash<QString, qint64>::iterator i = _pending.begin();
+    while (i != _pending.end())
+    {
+        QFileInfo info(i.key());
+        qint64 size = info.exists() ? info.size() : -1;
+
+        if ((size > 0) && (size == i.value()))
+        {
+            QString absolutePath = i.key();
+            i = _pending.erase(i);
+            emit fileReady(absolutePath);
+        }
+        else if (size < 0)
+        {
+            // Deleted before it settled
+            i = _pending.erase(i);
+        }
+        else
+        {
+            i.value() = size;
+            ++i;
+        }
+    }
+
+    if (_pending.isEmpty())
+    {
+        _settleTimer.stop();
+    }
+}
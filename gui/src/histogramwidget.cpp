@@ -1,5 +1,7 @@
 #include <QPainter>
+#include <algorithm>
 #include <math.h>
+#include <vector>
 
 #include "histogramwidget.h"
 
@@ -8,7 +10,8 @@ HistogramWidget::HistogramWidget(QWidget* parent /* = nullptr */)
       _isColor(false),
       _numPoints(0),
       _data(),
-      _histImage(0)
+      _prefixSums(),
+      _histImage()
 {
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Maximum);
 }
@@ -29,15 +32,155 @@ QSize HistogramWidget::minimumSizeHint() const
 
 void HistogramWidget::setHistogramData(bool isColor,
                                        int numPoints,
-                                       std::shared_ptr<const uint32_t[]> data)
+                                       std::shared_ptr<const uint32_t[]> data,
+                                       std::shared_ptr<const uint64_t[]> prefixSums)
 {
+    // Showing the same item again, e.g. to change its stretch
+    if ((data == _data) && (isColor == _isColor) && (numPoints == _numPoints))
+    {
+        return;
+    }
+
     _isColor = isColor;
     _numPoints = numPoints;
     _data = data;
+    _prefixSums = prefixSums;
+    if ((_data == 0) || (_prefixSums == 0))
+    {
+        _data.reset();
+        _prefixSums.reset();
+    }
+    _histImage = QImage();
 
     update();
 }
 
+/* static */
+std::shared_ptr<const uint64_t[]> HistogramWidget::makePrefixSums(bool isColor,
+                                                                  int numPoints,
+                                                                  const uint32_t* data)
+{
+    int numChan = isColor ? 3 : 1;
+    std::shared_ptr<uint64_t[]> prefixSums(new uint64_t[(int64_t)numChan * (numPoints + 1)]);
+    for (int chan = 0; chan < numChan; chan++)
+    {
+        const uint32_t* points = &data[(int64_t)numPoints * chan];
+        uint64_t* sums = &prefixSums[(int64_t)(numPoints + 1) * chan];
+        sums[0] = 0;
+        for (int i = 0; i < numPoints; i++)
+        {
+            sums[i + 1] = sums[i] + points[i];
+        }
+    }
+
+    return prefixSums;
+}
+
+void HistogramWidget::resizeEvent(QResizeEvent* event)
+{
+    _histImage = QImage();
+
+    QWidget::resizeEvent(event);
+}
+
+double HistogramWidget::sumTo(int chan,
+                              double idx) const
+{
+    const uint64_t* sums = &_prefixSums[(int64_t)(_numPoints + 1) * chan];
+
+    int whole = (int)floor(idx);
+    if (whole >= _numPoints)
+    {
+        return (double)sums[_numPoints];
+    }
+
+    double partial = (idx - whole) * _data[(int64_t)_numPoints * chan + whole];
+    return (double)sums[whole] + partial;
+}
+
+QImage HistogramWidget::rasterise(int w,
+                                  int h) const
+{
+    const int numChan = _isColor ? 3 : 1;
+    const double pointsPerPixel = (double)_numPoints / w;
+
+    // Each column is the mean of the points under it, so O(w) whatever
+    // the width
+    std::vector<double> averagedHist((size_t)w * numChan);
+    double tallest[3] = {0.0, 0.0, 0.0};
+    for (int chan = 0; chan < numChan; chan++)
+    {
+        double low = sumTo(chan, 0.0);
+        for (int x = 0; x < w; x++)
+        {
+            double high = sumTo(chan, (x + 1) * pointsPerPixel);
+            double mean = floor((high - low) / pointsPerPixel);
+            averagedHist[(size_t)w * chan + x] = mean;
+            tallest[chan] = std::max(tallest[chan], mean);
+            low = high;
+        }
+    }
+
+    // Scale to the tallest peak in any channel
+    double factor = 1.0;
+    for (int chan = 0; chan < numChan; chan++)
+    {
+        if (tallest[chan] == 0.0)
+        {
+            continue;
+        }
+
+        double tmp = (double)h / tallest[chan];
+        if (!_isColor || (tmp < factor))
+        {
+            factor = tmp;
+        }
+    }
+
+    // Column heights; a non-empty column shows at least one pixel
+    std::vector<int> val((size_t)w * numChan);
+    for (size_t i = 0; i < val.size(); i++)
+    {
+        val[i] = (int)(averagedHist[i] * factor);
+        if ((val[i] == 0) && (averagedHist[i] != 0.0))
+        {
+            val[i] = 1;
+        }
+    }
+
+    // Where channels overlap their colours add, so the part every
+    // channel reaches is grey
+    const int brightness = 200;
+    QImage image(w, h + 1, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y <= h; y++)
+    {
+        const int rise = h - y;
+        QRgb* line = (QRgb*)image.scanLine(y);
+        for (int x = 0; x < w; x++)
+        {
+            int rgb[] = {0, 0, 0};
+            bool lit = false;
+            for (int chan = 0; chan < numChan; chan++)
+            {
+                int colVal = val[(size_t)w * chan + x];
+                if ((colVal > 0) && (rise <= colVal))
+                {
+                    rgb[chan] = brightness;
+                    lit = true;
+                }
+            }
+
+            if (!_isColor)
+            {
+                rgb[1] = rgb[2] = rgb[0];
+            }
+            line[x] = lit ? qRgb(rgb[0], rgb[1], rgb[2]) : 0;
+        }
+    }
+
+    return image;
+}
+
 void HistogramWidget::paintEvent(QPaintEvent* event)
 {
     (void)event;
@@ -69,169 +212,15 @@ void HistogramWidget::paintEvent(QPaintEvent* event)
     painter.drawLine(realWidth * 0.75, realHeight - borderBottom / 2 - hashHeight / 2,
                      realWidth * 0.75, realHeight - borderBottom / 2 + hashHeight / 2);
 
-    if (_data != 0)
+    if ((_data == 0) || (w <= 0) || (h <= 0))
     {
-        double pointsPerPixel = (double)_numPoints / w;
-
-        int histogramSize = w;
-        if (_isColor)
-        {
-            histogramSize *= 3;
-        }
-        uint32_t* averagedHist = new uint32_t[histogramSize];
-        for (int i = 0; i < histogramSize; i++)
-        {
-            averagedHist[i] = 0;
-        }
-
-        double accumulator[3] = {0.0, 0.0, 0.0};
-        uint32_t tallest[3] = {0, 0, 0};
-        double dataIdxLow = 0.0;
-        double dataIdxHigh = dataIdxLow + pointsPerPixel;
-        int numChan = 1;
-        if (_isColor)
-        {
-            numChan = 3;
-        }
-        for (int i = 0; i < w; i++)
-        {
-            int lowIdxInt = (int)floor(dataIdxLow);
-            int highIdxInt = (int)floor(dataIdxHigh);
-
-            for (int chan = 0; chan < numChan; chan++)
-            {
-                double leftPartial = ((lowIdxInt + 1) - dataIdxLow) * _data[_numPoints * chan + lowIdxInt];
-                double rightPartial = (highIdxInt < _numPoints) ? (dataIdxHigh - highIdxInt) * _data[_numPoints * chan + highIdxInt] : 0.0;
-                accumulator[chan] = leftPartial + rightPartial;
-                for (int j = lowIdxInt + 1; j < highIdxInt; j++)
-                {
-                    accumulator[chan] += _data[_numPoints * chan + j];
-                }
-
-                averagedHist[w * chan + i] = accumulator[chan] / pointsPerPixel;
-                if (averagedHist[w * chan + i] > tallest[chan])
-                {
-                    tallest[chan] = averagedHist[w * chan + i];
-                }
-            }
-
-            dataIdxLow = dataIdxHigh;
-            dataIdxHigh = dataIdxLow + pointsPerPixel;
-        }
-
-        int brightness = 200;
-        if (!_isColor)
-        {
-            painter.setPen(QColor::fromRgb(brightness, brightness, brightness));
-            double factor = (double)h / tallest[0];
-
-            for (int x = 0; x < w; x++)
-            {
-                bool wasZero = averagedHist[x] == 0;
-                int val = (int)(averagedHist[x] * factor);
-                if ((val == 0) && !wasZero)
-                {
-                    val = 1;
-                }
-                painter.drawLine(QPoint(border + x, border + h - val),
-                                 QPoint(border + x, border + h));
-            }
-        }
-        else
-        {
-            // Determine factor for the tallest peak in all channels
-            double factor = 1.0;
-            for (int chan = 0; chan < 3; chan++)
-            {
-                double tmp = (double)h / tallest[chan];
-                if (tmp < factor)
-                {
-                    factor = tmp;
-                }
-            }
-
-            int val[3] = {0, 0, 0};
-            for (int x = 0; x < w; x++)
-            {
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    bool wasZero = averagedHist[w * chan + x] == 0;
-                    val[chan] = (int)(averagedHist[w * chan + x] * factor);
-                    if ((val[chan] == 0) && !wasZero)
-                    {
-                        val[chan] = 1;
-                    }
-                }
-
-                int sortedIdx[] = {0, 1, 2};
-                int tmp;
-                if (val[sortedIdx[0]] < val[sortedIdx[1]])
-                {
-                    if (val[sortedIdx[1]] > val[sortedIdx[2]])
-                    {
-                        tmp = sortedIdx[1];
-                        sortedIdx[1] = sortedIdx[2];
-                        sortedIdx[2] = tmp;
-
-                        if (val[sortedIdx[0]] > val[sortedIdx[1]])
-                        {
-                            tmp = sortedIdx[0];
-                            sortedIdx[0] = sortedIdx[1];
-                            sortedIdx[1] = tmp;
-                        }
-                    }
-                }
-                else
-                {
-                    tmp = sortedIdx[0];
-                    sortedIdx[0] = sortedIdx[1];
-                    sortedIdx[1] = tmp;
-
-                    if (val[sortedIdx[1]] > val[sortedIdx[2]])
-                    {
-                        tmp = sortedIdx[1];
-                        sortedIdx[1] = sortedIdx[2];
-                        sortedIdx[2] = tmp;
-                    }
-
-                    if (val[sortedIdx[0]] > val[sortedIdx[1]])
-                    {
-                        tmp = sortedIdx[0];
-                        sortedIdx[0] = sortedIdx[1];
-                        sortedIdx[1] = tmp;
-                    }
-                }
-
-                // Single color; the highest channel
-                int rgb[] = {0, 0, 0};
-                rgb[sortedIdx[2]] = brightness;
-                if ((val[sortedIdx[2]] - val[sortedIdx[1]]) > 0)
-                {
-                    painter.setPen(QColor::fromRgb(rgb[0], rgb[1], rgb[2]));
-                    painter.drawLine(QPoint(border + x, border + h - val[sortedIdx[2]]),
-                                     QPoint(border + x, border + h - val[sortedIdx[1]]));
-                }
-
-                // Bi-color, the middle and highest channel
-                rgb[sortedIdx[1]] = brightness;
-                if ((val[sortedIdx[1]] - val[sortedIdx[0]]) > 0)
-                {
-                    painter.setPen(QColor::fromRgb(rgb[0], rgb[1], rgb[2]));
-                    painter.drawLine(QPoint(border + x, border + h - val[sortedIdx[1]]),
-                                     QPoint(border + x, border + h - val[sortedIdx[0]]));
-                }
-
-                // Gray; the portion all channels occupy
-                rgb[sortedIdx[0]] = brightness;
-                if (val[sortedIdx[0]] > 0)
-                {
-                    painter.setPen(QColor::fromRgb(rgb[0], rgb[1], rgb[2]));
-                    painter.drawLine(QPoint(border + x, border + h - val[sortedIdx[0]]),
-                                     QPoint(border + x, border + h));
-                }
-            }
-        }
+        return;
+    }
 
-        delete[] averagedHist;
+    if (_histImage.isNull())
+    {
+        _histImage = rasterise(w, h);
     }
+
+    painter.drawImage(border, border, _histImage);
 }
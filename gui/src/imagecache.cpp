@@ -0,0 +1,125 @@
+#include "imagecache.h"
+
+/* static */
+const int64_t ImageCache::g_defaultBudgetBytes = (int64_t)4096 * 1024 * 1024;
+
+ImageCache::ImageCache(int64_t budgetBytes /* = g_defaultBudgetBytes */)
+    : _budgetBytes(budgetBytes),
+      _lru(),
+      _lruPos(),
+      _hits(0),
+      _misses(0),
+      _lastUsage(0)
+{
+}
+
+ImageCache::~ImageCache()
+{
+}
+
+int64_t ImageCache::getBudgetBytes() const
+{
+    return _budgetBytes;
+}
+
+void ImageCache::setBudgetBytes(int64_t budgetBytes)
+{
+    _budgetBytes = budgetBytes;
+}
+
+void ImageCache::touch(ImageStore::Handle handle)
+{
+    forget(handle);
+    _lruPos.insert(handle, _lru.insert(_lru.end(), handle));
+}
+
+void ImageCache::forget(ImageStore::Handle handle)
+{
+    QHash<ImageStore::Handle, std::list<ImageStore::Handle>::iterator>::iterator i = _lruPos.find(handle);
+    if (i != _lruPos.end())
+    {
+        _lru.erase(*i);
+        _lruPos.erase(i);
+    }
+}
+
+void ImageCache::recordHit()
+{
+    _hits++;
+}
+
+void ImageCache::recordMiss()
+{
+    _misses++;
+}
+
+int ImageCache::getHits() const
+{
+    return _hits;
+}
+
+int ImageCache::getMisses() const
+{
+    return _misses;
+}
+
+int64_t ImageCache::getLastUsage() const
+{
+    return _lastUsage;
+}
+
+void ImageCache::enforce(ImageStore& store,
+                         ImageStore::Handle protectedHandle)
+{
+    int64_t usage = 0;
+    std::list<ImageStore::Handle>::const_iterator i;
+    for (i = _lru.begin(); i != _lru.end(); ++i)
+    {
+        // Only the item on show needs its histogram in full; the
+        // others were packed when they loaded, so this just drops it
+        if (*i != protectedHandle)
+        {
+            store.get(*i).compactHistogram();
+        }
+
+        usage += store.get(*i).getMemoryUsage();
+    }
+
+    const EvictStage stages[] = {ES_DISPLAY, ES_IMAGE, ES_HISTOGRAM};
+    for (int stageIdx = 0; (stageIdx < 3) && (usage > _budgetBytes); stageIdx++)
+    {
+        // Oldest first
+        for (i = _lru.begin(); (i != _lru.end()) && (usage > _budgetBytes); ++i)
+        {
+            if (*i == protectedHandle)
+            {
+                continue;
+            }
+
+            usage -= release(store.get(*i), stages[stageIdx]);
+        }
+    }
+
+    _lastUsage = usage;
+}
+
+/* static */
+int64_t ImageCache::release(ImageFileListItem& item,
+                            EvictStage stage)
+{
+    int64_t before = item.getMemoryUsage();
+    switch (stage)
+    {
+    case ES_IMAGE:
+        item.releaseImage();
+        break;
+    case ES_DISPLAY:
+        item.releaseDisplay();
+        break;
+    case ES_HISTOGRAM:
+        item.releaseHistogram();
+        break;
+    }
+
+    return before - item.getMemoryUsage();
+}
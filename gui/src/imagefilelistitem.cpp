@@ -1,6 +1,19 @@
+#include <QElapsedTimer>
+#include <algorithm>
+#include <utility>
+
+#include "orderstatisticsvisitor.h"
+#include "pixkernels.h"
 #include "pixutils.h"
 #include "statisticsvisitor.h"
+#include "histogramwidget.h"
 #include "imagefilelistitem.h"
+#include "lutstore.h"
+
+/* static */
+const int64_t ImageFileListItem::g_streamThresholdBytes = (int64_t)1024 * 1024 * 1024;
+/* static */
+const int64_t ImageFileListItem::g_streamedFrameMaxBytes = (int64_t)256 * 1024 * 1024;
 
 ImageFileListItem::ImageFileListItem()
     : ImageFileListItem("")
@@ -13,9 +26,18 @@ ImageFileListItem::ImageFileListItem(QString absolutePath,
     : _absolutePath(absolutePath),
       _fileType(fileType),
       _isValidated(isValidated),
-      _isLoaded(false),
       _showStretched(false),
       _image(),
+      _isStreamed(false),
+      _isColor(false),
+      _sampleFormat(ELS::SF_UINT_16),
+      _width(0),
+      _height(0),
+      _pixelDataSize(0),
+      _dateObs(),
+      _exposure(),
+      _filter(),
+      _object(),
       _stfParms(),
       _min(),
       _mean(),
@@ -25,12 +47,21 @@ ImageFileListItem::ImageFileListItem(QString absolutePath,
       _gOffset(0),
       _bOffset(0),
       _histogram(),
-      _stfLUT(0),
-      _identityLUT(0),
-      _lutInUse(0),
-      _qiData(),
-      _qi()
+      _histogramPrefixSums(),
+      _compactHistogram(),
+      _stfLUT(),
+      _identityLUT(),
+      _renderer(),
+      _altRenderer(),
+      _loadTimings{0, 0, 0, 0}
+{
+}
+
+ImageFileListItem::ImageFileListItem(QString absolutePath,
+                                     const ELS::Image::Info& info)
+    : ImageFileListItem(absolutePath, info.fileType, true)
 {
+    setInfo(info);
 }
 
 ImageFileListItem::~ImageFileListItem() {}
@@ -47,7 +78,7 @@ bool ImageFileListItem::isValidated() const
 
 bool ImageFileListItem::isLoaded() const
 {
-    return _isLoaded;
+    return hasDisplay() && hasHistogram();
 }
 
 bool ImageFileListItem::showStretched() const
@@ -57,7 +88,7 @@ bool ImageFileListItem::showStretched() const
 
 bool ImageFileListItem::isColor() const
 {
-    return _image->isColor();
+    return _isColor;
 }
 
 QString ImageFileListItem::getMin() const
@@ -87,12 +118,109 @@ int ImageFileListItem::getNumHistogramPoints() const
 
 std::shared_ptr<const uint32_t[]> ImageFileListItem::getHistogram() const
 {
+    if ((_histogram == 0) && (_compactHistogram != 0))
+    {
+        return _compactHistogram->expand();
+    }
+
     return _histogram;
 }
 
-std::shared_ptr<const QImage> ImageFileListItem::getQImage() const
+std::shared_ptr<const uint64_t[]> ImageFileListItem::getHistogramPrefixSums() const
 {
-    return _qi;
+    return _histogramPrefixSums;
+}
+
+std::shared_ptr<const DisplayRenderer> ImageFileListItem::getRenderer() const
+{
+    return _renderer;
+}
+
+QString ImageFileListItem::getDateObs() const
+{
+    return _dateObs;
+}
+
+QString ImageFileListItem::getExposure() const
+{
+    return _exposure;
+}
+
+QString ImageFileListItem::getFilter() const
+{
+    return _filter;
+}
+
+QString ImageFileListItem::getObject() const
+{
+    return _object;
+}
+
+ImageFileListItem::LoadTimings ImageFileListItem::getLoadTimings() const
+{
+    return _loadTimings;
+}
+
+int64_t ImageFileListItem::getMemoryUsage() const
+{
+    return getImageMemoryUsage() +
+           getDisplayMemoryUsage() +
+           getHistogramMemoryUsage();
+}
+
+int64_t ImageFileListItem::getImageMemoryUsage() const
+{
+    return hasImage() ? _pixelDataSize : 0;
+}
+
+int64_t ImageFileListItem::getDisplayMemoryUsage() const
+{
+    int64_t bytes = hasDisplay() ? _renderer->getMemoryUsage() : 0;
+    if (hasAlternate())
+    {
+        bytes += _altRenderer->getMemoryUsage();
+    }
+
+    return bytes;
+}
+
+int64_t ImageFileListItem::getHistogramMemoryUsage() const
+{
+    // Identity LUTs are one per process, so only the stretch LUT is
+    // counted; it's counted in full by each item that shares it
+    int chanCount = _isColor ? 3 : 1;
+    int64_t lutBytes = (_stfLUT != 0) ? (int64_t)_numHistogramPoints * chanCount : 0;
+    int64_t histogramBytes = (_histogram != 0) ? (int64_t)_numHistogramPoints * chanCount * sizeof(uint32_t) : 0;
+    if (_histogramPrefixSums != 0)
+    {
+        histogramBytes += (int64_t)(_numHistogramPoints + 1) * chanCount * sizeof(uint64_t);
+    }
+    if (_compactHistogram != 0)
+    {
+        histogramBytes += _compactHistogram->getMemoryUsage();
+    }
+
+    return lutBytes + histogramBytes;
+}
+
+bool ImageFileListItem::hasImage() const
+{
+    return _image != 0;
+}
+
+bool ImageFileListItem::hasDisplay() const
+{
+    return _renderer != 0;
+}
+
+bool ImageFileListItem::hasHistogram() const
+{
+    return (_histogram != 0) || (_compactHistogram != 0);
+}
+
+bool ImageFileListItem::hasFullHistogram() const
+{
+    return (_histogram != 0) && (_histogramPrefixSums != 0);
 }
 
 void ImageFileListItem::setValidated(bool isValidated)
@@ -105,57 +233,248 @@ void ImageFileListItem::setShowStretched(bool showStretched)
     if (_showStretched != showStretched)
     {
         _showStretched = showStretched;
-        if (_showStretched)
+
+        // A pointer swap when the other render was made in the
+        // background (see renderAlternate()). Otherwise the display
+        // goes, and the next load() renders it off the GUI thread
+        // while the caller keeps the old one up.
+        std::swap(_renderer, _altRenderer);
+    }
+}
+
+void ImageFileListItem::load()
+{
+    if (isLoaded())
+    {
+        return;
+    }
+
+    QByteArray ba = _absolutePath.toLocal8Bit();
+    const char* filename = ba.data();
+
+    if (!_isValidated)
+    {
+        char error[2048];
+        ELS::Image::Info info;
+        _fileType = ELS::Image::probe(filename, &info, error);
+
+        if (_fileType == ELS::Image::FT_UNKNOWN)
         {
-            _lutInUse = _stfLUT;
+            printf("Failed to load image file '%s': %s", filename, error);
+            return;
         }
-        else
+
+        setInfo(info);
+        _isValidated = true;
+    }
+
+    _loadTimings = {0, 0, 0, 0};
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Only FITS can be read in bands, so only FITS is worth a look
+    // at the header before deciding how to read it. Probed items
+    // already have it.
+    if (_fileType == ELS::Image::FT_FITS)
+    {
+        if (_width == 0)
         {
-            _lutInUse = _identityLUT;
+            readInfo(filename);
         }
+        _isStreamed = _pixelDataSize > g_streamThresholdBytes;
+    }
+
+    if (!hasImage() && !_isStreamed)
+    {
+        _image.reset(ELS::Image::load(filename, _fileType));
+        _isColor = _image->isColor();
+        _sampleFormat = _image->getSampleFormat();
+        _width = _image->getWidth();
+        _height = _image->getHeight();
+        _pixelDataSize = _image->getPixelDataSize();
+        _loadTimings.decodeMs = timer.restart();
+    }
+
+    if (!hasHistogram())
+    {
+        calculateStatistics();
+        _loadTimings.statsMs = timer.restart();
+    }
 
-        ToQImageVisitor visitor(_stfParms, _lutInUse, _numHistogramPoints);
-        _image->visitPixels(&visitor);
-        _qiData = visitor.getImageData();
-        _qi = visitor.getImage();
+    // Renders come back to the pixels for as long as the item lives,
+    // by which time the file may have been rewritten (see --watch);
+    // only the first pass reads straight from it
+    if (hasImage())
+    {
+        _image->detachFromFile();
+        _loadTimings.decodeMs += timer.restart();
+    }
+
+    if (!hasDisplay())
+    {
+        std::shared_ptr<const uint8_t[]> lut = getLUT(_showStretched);
+        _loadTimings.lutMs = timer.restart();
+
+        _renderer = makeRenderer(lut);
+        _loadTimings.renderMs = timer.restart();
     }
+
+    printf("Loaded %s: decode %lld ms, stats %lld ms, luts %lld ms, render %lld ms\n",
+           filename,
+           _loadTimings.decodeMs,
+           _loadTimings.statsMs,
+           _loadTimings.lutMs,
+           _loadTimings.renderMs);
+    fflush(stdout);
 }
 
-void ImageFileListItem::load()
+void ImageFileListItem::adoptLoaded(const ImageFileListItem& loaded)
+{
+    bool showStretched = _showStretched;
+    std::shared_ptr<const DisplayRenderer> renderer = _renderer;
+    std::shared_ptr<const DisplayRenderer> altRenderer = _altRenderer;
+
+    *this = loaded;
+
+    if (_showStretched != showStretched)
+    {
+        _showStretched = showStretched;
+        std::swap(_renderer, _altRenderer);
+    }
+
+    // Renders made here while the copy was loading, e.g. an adopted
+    // alternate, are as good as the copy's
+    if (_renderer == 0)
+    {
+        _renderer = renderer;
+    }
+    if (_altRenderer == 0)
+    {
+        _altRenderer = altRenderer;
+    }
+}
+
+void ImageFileListItem::renderAlternate()
 {
-    if (!_isLoaded)
+    if ((_altRenderer != 0) || !hasHistogram())
     {
-        QByteArray ba = _absolutePath.toLocal8Bit();
-        const char* filename = ba.data();
+        return;
+    }
+
+    _altRenderer = makeRenderer(getLUT(!_showStretched));
+}
+
+bool ImageFileListItem::hasAlternate() const
+{
+    return _altRenderer != 0;
+}
+
+void ImageFileListItem::adoptAlternate(const ImageFileListItem& rendered)
+{
+    if (rendered._altRenderer == 0)
+    {
+        return;
+    }
 
-        if (!_isValidated)
+    // The stretch may have been toggled since the render was asked
+    // for, so it goes in whichever slot matches its LUT
+    if (rendered._showStretched != _showStretched)
+    {
+        if (_renderer == 0)
         {
-            char error[2048];
-            _fileType = ELS::Image::isSupportedFile(filename, error);
+            _renderer = rendered._altRenderer;
+        }
+    }
+    else if (_altRenderer == 0)
+    {
+        _altRenderer = rendered._altRenderer;
+    }
+}
+
+void ImageFileListItem::releaseImage()
+{
+    _image.reset();
+
+    // Displays rendered from the raw pixels go with them
+    if (!_isStreamed)
+    {
+        _renderer.reset();
+        _altRenderer.reset();
+    }
+}
+
+void ImageFileListItem::releaseDisplay()
+{
+    _renderer.reset();
+    _altRenderer.reset();
+}
+
+void ImageFileListItem::releaseHistogram()
+{
+    _histogram.reset();
+    _histogramPrefixSums.reset();
+    _compactHistogram.reset();
+}
+
+void ImageFileListItem::packHistogram()
+{
+    if ((_histogram == 0) || (_compactHistogram != 0))
+    {
+        return;
+    }
 
-            if (_fileType == ELS::Image::FT_UNKNOWN)
-            {
-                printf("Failed to load image file '%s': %s", filename, error);
-                return;
-            }
+    int totalHistogramPoints = _isColor ? _numHistogramPoints * 3 : _numHistogramPoints;
+    _compactHistogram.reset(new CompactHistogram(_histogram.get(), totalHistogramPoints));
+}
 
-            _isValidated = true;
+void ImageFileListItem::expandHistogram()
+{
+    if (_histogram == 0)
+    {
+        if (_compactHistogram == 0)
+        {
+            return;
         }
 
-        _image.reset(ELS::Image::load(filename, _fileType));
+        _histogram = _compactHistogram->expand();
+    }
 
-        calculateStatistics();
-        calculateLUTs();
+    if (_histogramPrefixSums == 0)
+    {
+        _histogramPrefixSums = HistogramWidget::makePrefixSums(_isColor,
+                                                               _numHistogramPoints,
+                                                               _histogram.get());
+    }
+}
 
-        ToQImageVisitor visitor(_stfParms, _lutInUse, _numHistogramPoints);
-        _image->visitPixels(&visitor);
-        _qiData = visitor.getImageData();
-        _qi = visitor.getImage();
+void ImageFileListItem::adoptHistogram(const ImageFileListItem& expanded)
+{
+    // Nothing to add to if the histogram was released (or the file
+    // rewritten) while this one was being expanded
+    if (!hasHistogram() || hasFullHistogram() || !expanded.hasFullHistogram() ||
+        (expanded._numHistogramPoints != _numHistogramPoints))
+    {
+        return;
+    }
 
-        _isLoaded = true;
+    _histogram = expanded._histogram;
+    _histogramPrefixSums = expanded._histogramPrefixSums;
+    if (_compactHistogram == 0)
+    {
+        _compactHistogram = expanded._compactHistogram;
     }
 }
 
+void ImageFileListItem::compactHistogram()
+{
+    // The slow path, for an item whose load was never packed
+    packHistogram();
+
+    _histogram.reset();
+    _histogramPrefixSums.reset();
+}
+
 void ImageFileListItem::streamTo(QDataStream& out) const
 {
     out << _absolutePath
@@ -167,10 +486,11 @@ void ImageFileListItem::streamFrom(QDataStream& in)
 {
     in >> _absolutePath >> _fileType >> _isValidated;
 
-    _isLoaded = false;
     _showStretched = false;
 
     _image.reset();
+    releaseDisplay();
+    releaseHistogram();
 }
 
 bool ImageFileListItem::operator==(const ImageFileListItem& rhs) const
@@ -203,9 +523,66 @@ bool ImageFileListItem::operator>=(const ImageFileListItem& rhs) const
     return _absolutePath >= rhs._absolutePath;
 }
 
+void ImageFileListItem::readInfo(const char* filename)
+{
+    setInfo(ELS::Image::readInfo(filename, _fileType));
+}
+
+void ImageFileListItem::setInfo(const ELS::Image::Info& info)
+{
+    _isColor = info.isColor;
+    _sampleFormat = info.sampleFormat;
+    _width = info.width;
+    _height = info.height;
+    _pixelDataSize = (int64_t)_width * _height * ELS::Image::getBytesPerSample(_sampleFormat);
+    if (_isColor)
+    {
+        _pixelDataSize *= 3;
+    }
+
+    _dateObs = QString::fromStdString(info.dateObs);
+    _exposure = QString::fromStdString(info.exposure);
+    _filter = QString::fromStdString(info.filter);
+    _object = QString::fromStdString(info.object);
+}
+
+void ImageFileListItem::visitPixels(ELS::PixelVisitor* visitor)
+{
+    if (hasImage())
+    {
+        _image->visitPixelsParallel(visitor);
+    }
+    else
+    {
+        QByteArray ba = _absolutePath.toLocal8Bit();
+        ELS::Image::streamPixels(ba.data(), _fileType, {visitor});
+    }
+}
+
+// StatisticsVisitor bins 8-bit samples into 256 points and 16-bit ones
+// into 65536, a point per value, so their order statistics are exact.
+// 32-bit integers and floating point share 2^20 points
+// (PixUtils::g_wideHistogramBits), which only pins the median and MAD
+// down to a bin; OrderStatisticsVisitor narrows them to the sample.
+template <typename PixelT>
+void ImageFileListItem::refineStatistics(ELS::StatisticsVisitor<PixelT>* coarse,
+                                         ELS::PixStatistics<PixelT>* statistics)
+{
+    int numPoints = 0;
+    std::shared_ptr<uint32_t[]> histogram;
+    coarse->getHistogramData(&numPoints, &histogram);
+
+    ELS::OrderStatisticsVisitor<PixelT> refiner(*statistics, histogram.get(), _isColor);
+    while (!refiner.isComplete())
+    {
+        visitPixels(&refiner);
+    }
+    refiner.getStatistics(statistics);
+}
+
 void ImageFileListItem::calculateStatistics()
 {
-    bool isColor = _image->isColor();
+    bool isColor = _isColor;
 
     QString gMinF(" min: %1 ");
     QString gMeanF(" mean: %1 ");
@@ -216,12 +593,12 @@ void ImageFileListItem::calculateStatistics()
     QString cMedF(" median: %1 | %2 | %3 ");
     QString cMaxF(" max: %1 | %2 | %3 ");
 
-    switch (_image->getSampleFormat())
+    switch (_sampleFormat)
     {
     case ELS::SF_UINT_8:
     {
         ELS::StatisticsVisitor<uint8_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<uint8_t> localStats = visitor.getStatistics();
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
@@ -255,7 +632,7 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_UINT_16:
     {
         ELS::StatisticsVisitor<uint16_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<uint16_t> localStats = visitor.getStatistics();
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
@@ -289,8 +666,9 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_UINT_32:
     {
         ELS::StatisticsVisitor<uint32_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<uint32_t> localStats = visitor.getStatistics();
+        refineStatistics(&visitor, &localStats);
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
         {
@@ -323,7 +701,7 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_INT_8:
     {
         ELS::StatisticsVisitor<int8_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<int8_t> localStats = visitor.getStatistics();
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
@@ -357,7 +735,7 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_INT_16:
     {
         ELS::StatisticsVisitor<int16_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<int16_t> localStats = visitor.getStatistics();
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
@@ -391,8 +769,9 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_INT_32:
     {
         ELS::StatisticsVisitor<int32_t> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<int32_t> localStats = visitor.getStatistics();
+        refineStatistics(&visitor, &localStats);
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
         {
@@ -425,8 +804,9 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_FLOAT:
     {
         ELS::StatisticsVisitor<float> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<float> localStats = visitor.getStatistics();
+        refineStatistics(&visitor, &localStats);
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
         {
@@ -459,8 +839,9 @@ void ImageFileListItem::calculateStatistics()
     case ELS::SF_DOUBLE:
     {
         ELS::StatisticsVisitor<double> visitor;
-        _image->visitPixels(&visitor);
+        visitPixels(&visitor);
         ELS::PixStatistics<double> localStats = visitor.getStatistics();
+        refineStatistics(&visitor, &localStats);
         _stfParms = localStats.getStretchParameters();
         if (!isColor)
         {
@@ -493,85 +874,90 @@ void ImageFileListItem::calculateStatistics()
     }
 }
 
-void ImageFileListItem::calculateLUTs()
+std::shared_ptr<const DisplayRenderer> ImageFileListItem::makeRenderer(std::shared_ptr<const uint8_t[]> lut)
 {
-    int totalHistogramPoints = _numHistogramPoints;
-    bool isColor = _image->isColor();
-    if (isColor)
+    // Resident pixels are rendered a region at a time, as the widget
+    // needs them. Streamed ones can't be revisited cheaply, so they
+    // get one render of the whole image, reduced as it streams until
+    // it fits in g_streamedFrameMaxBytes. Either way the zoomed-out
+    // levels are built now, off the GUI thread.
+    std::shared_ptr<DisplayRenderer> renderer;
+    if (hasImage())
     {
-        totalHistogramPoints *= 3;
+        renderer.reset(new DisplayRenderer(_image, lut, _numHistogramPoints, lut == _identityLUT));
     }
-    _stfLUT = new uint8_t[totalHistogramPoints];
-    _identityLUT = new uint8_t[totalHistogramPoints];
-    _lutInUse = _identityLUT;
-
-    ELS::PixSTFParms stfIdentityParms;
-    for (int i = 0; i < _numHistogramPoints; i++)
+    else
     {
-        if (isColor)
-        {
-            int chanOffset[3] = {
-                0,
-                _gOffset,
-                _bOffset};
-            for (int chan = 0; chan < 3; chan++)
-            {
-                // Only calculate points that are in the image
-                if (_histogram[chanOffset[chan] + i] != 0)
-                {
-                    _stfLUT[chanOffset[chan] + i] = (uint8_t)(ELS::PixUtils::screenTransferFunc((uint16_t)i,
-                                                                                                &_stfParms,
-                                                                                                chan) *
-                                                              ELS::PixUtils::g_u8Max);
-                    _identityLUT[chanOffset[chan] + i] = (uint8_t)(ELS::PixUtils::screenTransferFunc((uint16_t)i,
-                                                                                                     &stfIdentityParms,
-                                                                                                     chan) *
-                                                                   ELS::PixUtils::g_u8Max);
-                }
-            }
-        }
-        else
+        const int bytesPerPixel = _isColor ? 4 : 1;
+        int frameScale = 1;
+        while ((int64_t)((_width + frameScale - 1) / frameScale) *
+                   ((_height + frameScale - 1) / frameScale) * bytesPerPixel >
+               g_streamedFrameMaxBytes)
         {
-            // Only calculate points that are in the image
-            if (_histogram[i] != 0)
-            {
-                _stfLUT[i] = (uint8_t)(ELS::PixUtils::screenTransferFunc((uint16_t)i,
-                                                                         &_stfParms) *
-                                       ELS::PixUtils::g_u8Max);
-                _identityLUT[i] = (uint8_t)(ELS::PixUtils::screenTransferFunc((uint16_t)i,
-                                                                              &stfIdentityParms) *
-                                            ELS::PixUtils::g_u8Max);
-            }
+            frameScale *= 2;
         }
+
+        ToQImageVisitor visitor(_stfParms, lut.get(), _numHistogramPoints, frameScale);
+        visitPixels(&visitor);
+        renderer.reset(new DisplayRenderer(visitor.getImage(), _width, _height, frameScale));
+    }
+    renderer->buildPyramid();
+
+    return renderer;
+}
+
+std::shared_ptr<const uint8_t[]> ImageFileListItem::getLUT(bool stretched)
+{
+    if (_identityLUT == 0)
+    {
+        _identityLUT = LutStore::getIdentity(_numHistogramPoints, _isColor);
+    }
+
+    // Most items are never shown stretched
+    if (stretched && (_stfLUT == 0))
+    {
+        _stfLUT = LutStore::getStretch(_numHistogramPoints, _isColor, _stfParms);
     }
+
+    return stretched ? _stfLUT : _identityLUT;
 }
 
 ImageFileListItem::ToQImageVisitor::ToQImageVisitor(ELS::PixSTFParms stfParms,
-                                                    uint8_t* lut,
-                                                    int lutPoints)
-    : _width(0),
+                                                    const uint8_t* lut,
+                                                    int lutPoints,
+                                                    int reduction /* = 1 */)
+    : _isClone(false),
+      _width(0),
       _height(0),
       _pixCount(0),
+      _isGray(false),
       _qiData(),
+      _grayData(),
       _stride(0),
       _stfParms(stfParms),
       _qi(),
       _lut(lut),
       _lutPoints(lutPoints),
       _gOffset(lutPoints),
-      _bOffset(lutPoints * 2)
+      _bOffset(lutPoints * 2),
+      _reduction(reduction),
+      _reductionShift(0),
+      _outWidth(0),
+      _outHeight(0),
+      _grayRow(),
+      _rgbRow(),
+      _blockSums()
 {
+    while ((2 << _reductionShift) <= _reduction)
+    {
+        _reductionShift++;
+    }
 }
 
 ImageFileListItem::ToQImageVisitor::~ToQImageVisitor()
 {
 }
 
-std::shared_ptr<uint32_t[]> ImageFileListItem::ToQImageVisitor::getImageData()
-{
-    return _qiData;
-}
-
 std::shared_ptr<QImage> ImageFileListItem::ToQImageVisitor::getImage()
 {
     return _qi;
@@ -579,7 +965,8 @@ std::shared_ptr<QImage> ImageFileListItem::ToQImageVisitor::getImage()
 
 void ImageFileListItem::ToQImageVisitor::pixelFormat(ELS::PixelFormat pf)
 {
-    (void)pf;
+    // Grey renders are 8-bit, a quarter the size of ARGB32
+    _isGray = (pf == ELS::PF_GRAY);
 }
 
 void ImageFileListItem::ToQImageVisitor::dimensions(int width,
@@ -587,9 +974,34 @@ void ImageFileListItem::ToQImageVisitor::dimensions(int width,
 {
     _width = width;
     _height = height;
-    _pixCount = _width * _height;
+    _outWidth = (_width + _reduction - 1) / _reduction;
+    _outHeight = (_height + _reduction - 1) / _reduction;
+    _pixCount = (int64_t)_outWidth * _outHeight;
+
+    if (!_isClone)
+    {
+        if (_isGray)
+        {
+            _grayData.reset(new uint8_t[_pixCount]);
+        }
+        else
+        {
+            _qiData.reset(new uint32_t[_pixCount]);
+        }
+    }
 
-    _qiData.reset(new uint32_t[_pixCount]);
+    if (_reduction > 1)
+    {
+        if (_isGray)
+        {
+            _grayRow.reset(new uint8_t[_width]);
+        }
+        else
+        {
+            _rgbRow.reset(new uint32_t[_width]);
+        }
+        _blockSums.assign((size_t)_outWidth * (_isGray ? 1 : 3), 0);
+    }
 }
 
 void ImageFileListItem::ToQImageVisitor::rowInfo(int stride)
@@ -600,129 +1012,57 @@ void ImageFileListItem::ToQImageVisitor::rowInfo(int stride)
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const int8_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const int16_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const int32_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const uint8_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const uint16_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const uint32_t* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const float* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowGray(int y,
                                                  const double* k)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(k[dataIdx]);
-        uint8_t val = _lut[tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (val << 16) |
-                                 (val << 8) |
-                                 (val);
-    }
+    ELS::PixKernels::renderGray(k, _width, _stride, _lut, grayRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -730,23 +1070,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const int8_t* g,
                                                 const int8_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -754,23 +1081,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const int16_t* g,
                                                 const int16_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -778,23 +1092,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const int32_t* g,
                                                 const int32_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -802,23 +1103,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const uint8_t* g,
                                                 const uint8_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -826,23 +1114,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const uint16_t* g,
                                                 const uint16_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -850,23 +1125,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const uint32_t* g,
                                                 const uint32_t* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -874,23 +1136,10 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const float* g,
                                                 const float* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
-    {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
-
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
-
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
-    }
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
 }
 
 void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
@@ -898,26 +1147,108 @@ void ImageFileListItem::ToQImageVisitor::rowRgb(int y,
                                                 const double* g,
                                                 const double* b)
 {
-    int rowOffset = y * _width;
-    for (int x = 0, dataIdx = 0; x < _width; x++, dataIdx += _stride)
+    ELS::PixKernels::renderRgb(r, g, b, _width, _stride,
+                               _lut, &_lut[_gOffset], &_lut[_bOffset],
+                               rgbRow(y));
+    reduceRow(y);
+}
+
+ELS::PixelVisitor* ImageFileListItem::ToQImageVisitor::clone() const
+{
+    if (_reduction > 1)
     {
-        uint16_t tmp = ELS::PixUtils::convertRangeToHist(r[dataIdx]);
-        uint8_t red = _lut[tmp];
+        return 0;
+    }
 
-        tmp = ELS::PixUtils::convertRangeToHist(g[dataIdx]);
-        uint8_t green = _lut[_gOffset + tmp];
+    ToQImageVisitor* part = new ToQImageVisitor(_stfParms, _lut, _lutPoints);
+    part->_isClone = true;
+    part->_isGray = _isGray;
+    part->_qiData = _qiData;
+    part->_grayData = _grayData;
 
-        tmp = ELS::PixUtils::convertRangeToHist(b[dataIdx]);
-        uint8_t blue = _lut[_bOffset + tmp];
+    return part;
+}
 
-        _qiData[rowOffset + x] = (0xff << 24) |
-                                 (red << 16) |
-                                 (green << 8) |
-                                 (blue);
+void ImageFileListItem::ToQImageVisitor::done()
+{
+    // The QImage doesn't own its pixels; hold a reference to them for
+    // as long as anyone (e.g. ImageWidget) holds the QImage
+    if (_isGray)
+    {
+        std::shared_ptr<uint8_t[]> grayData = _grayData;
+        _qi = std::shared_ptr<QImage>(new QImage((const uchar*)_grayData.get(), _outWidth, _outHeight, _outWidth, QImage::Format_Grayscale8),
+                                      [grayData](QImage* qi)
+                                      { delete qi; });
+    }
+    else
+    {
+        std::shared_ptr<uint32_t[]> qiData = _qiData;
+        _qi = std::shared_ptr<QImage>(new QImage((const uchar*)_qiData.get(), _outWidth, _outHeight, QImage::Format_RGB32),
+                                      [qiData](QImage* qi)
+                                      { delete qi; });
     }
 }
 
-void ImageFileListItem::ToQImageVisitor::done()
+uint8_t* ImageFileListItem::ToQImageVisitor::grayRow(int y)
+{
+    return (_reduction > 1) ? _grayRow.get() : &_grayData[(int64_t)y * _width];
+}
+
+uint32_t* ImageFileListItem::ToQImageVisitor::rgbRow(int y)
+{
+    return (_reduction > 1) ? _rgbRow.get() : &_qiData[(int64_t)y * _width];
+}
+
+void ImageFileListItem::ToQImageVisitor::reduceRow(int y)
 {
-    _qi.reset(new QImage((const uchar*)_qiData.get(), _width, _height, QImage::Format_RGB32));
+    if (_reduction == 1)
+    {
+        return;
+    }
+
+    uint32_t* sums = _blockSums.data();
+    if (_isGray)
+    {
+        for (int x = 0; x < _width; x++)
+        {
+            sums[x >> _reductionShift] += _grayRow[x];
+        }
+    }
+    else
+    {
+        for (int x = 0; x < _width; x++)
+        {
+            uint32_t pix = _rgbRow[x];
+            uint32_t* sum = &sums[(x >> _reductionShift) * 3];
+            sum[0] += (pix >> 16) & 0xff;
+            sum[1] += (pix >> 8) & 0xff;
+            sum[2] += pix & 0xff;
+        }
+    }
+
+    // Blocks on the right and bottom edges can be short
+    if ((((y + 1) & (_reduction - 1)) != 0) && (y + 1 < _height))
+    {
+        return;
+    }
+
+    const int blockRows = (y & (_reduction - 1)) + 1;
+    const int64_t outRow = (int64_t)(y >> _reductionShift) * _outWidth;
+    for (int x = 0; x < _outWidth; x++)
+    {
+        uint32_t count = (uint32_t)(blockRows * std::min(_reduction, _width - x * _reduction));
+        if (_isGray)
+        {
+            _grayData[outRow + x] = (uint8_t)((sums[x] + count / 2) / count);
+        }
+        else
+        {
+            const uint32_t* sum = &sums[x * 3];
+            _qiData[outRow + x] = 0xff000000u |
+                                  (((sum[0] + count / 2) / count) << 16) |
+                                  (((sum[1] + count / 2) / count) << 8) |
+                                  ((sum[2] + count / 2) / count);
+        }
+    }
+    std::fill(_blockSums.begin(), _blockSums.end(), 0);
 }
@@ -0,0 +1,282 @@
+#include <QMetaType>
+#include <stdio.h>
+
+#include "imageloadexception.h"
+#include "imageloader.h"
+#include "pixelvisitortypemismatch.h"
+
+ImageLoader::ImageLoader(QObject* parent /* = nullptr */)
+    : QObject(parent),
+      _pool(),
+      _pending(),
+      _pendingAlternates(),
+      _pendingHistograms(),
+      _generations()
+{
+    qRegisterMetaType<ImageFileListItem>("ImageFileListItem");
+
+    _pool.setMaxThreadCount(g_threadCount);
+
+    // Signals are emitted from worker threads, so these arrive queued
+    // on the thread this object lives in (the GUI thread). Results
+    // of superseded tasks stop here; the newer task is still pending.
+    QObject::connect(this, &ImageLoader::loadFinished,
+                     this, [this](ImageFileListItem item, quint64 generation)
+                     {
+                         if (isCurrent(item.absolutePath(), generation))
+                         {
+                             _pending.remove(item.absolutePath());
+                             emit itemLoaded(item);
+                         }
+                     });
+    QObject::connect(this, &ImageLoader::loadFailed,
+                     this, [this](QString absolutePath, QString errText, quint64 generation)
+                     {
+                         if (isCurrent(absolutePath, generation))
+                         {
+                             _pending.remove(absolutePath);
+                             emit itemFailed(absolutePath, errText);
+                         }
+                     });
+    QObject::connect(this, &ImageLoader::alternateFinished,
+                     this, [this](ImageFileListItem item, quint64 generation)
+                     {
+                         if (isCurrent(item.absolutePath(), generation))
+                         {
+                             _pendingAlternates.remove(item.absolutePath());
+                             emit alternateRendered(item);
+                         }
+                     });
+    QObject::connect(this, &ImageLoader::histogramFinished,
+                     this, [this](ImageFileListItem item, quint64 generation)
+                     {
+                         if (isCurrent(item.absolutePath(), generation))
+                         {
+                             _pendingHistograms.remove(item.absolutePath());
+                             emit histogramExpanded(item);
+                         }
+                     });
+}
+
+ImageLoader::~ImageLoader()
+{
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+bool ImageLoader::requestLoad(const ImageFileListItem& item,
+                              int priority /* = g_prefetchPriority */,
+                              bool supersede /* = false */)
+{
+    const QString absolutePath = item.absolutePath();
+    if (supersede &&
+        (_pending.contains(absolutePath) ||
+         _pendingAlternates.contains(absolutePath) ||
+         _pendingHistograms.contains(absolutePath)))
+    {
+        // Whatever was read so far may be of a partly written file
+        _generations.insert(absolutePath, _generations.value(absolutePath, 0) + 1);
+        _pending.remove(absolutePath);
+        _pendingAlternates.remove(absolutePath);
+        _pendingHistograms.remove(absolutePath);
+    }
+
+    if (_pending.contains(absolutePath))
+    {
+        return false;
+    }
+
+    _pending.insert(absolutePath);
+    _pool.start(new LoadTask(this,
+                             item,
+                             _generations.value(absolutePath, 0),
+                             priority >= g_currentPriority),
+                priority);
+
+    return true;
+}
+
+bool ImageLoader::requestAlternate(const ImageFileListItem& item)
+{
+    if (_pendingAlternates.contains(item.absolutePath()))
+    {
+        return false;
+    }
+
+    // Below prefetches: the toggle falls back to a background load if
+    // it's pressed before this is done
+    _pendingAlternates.insert(item.absolutePath());
+    _pool.start(new AlternateTask(this, item, _generations.value(item.absolutePath(), 0)),
+                g_prefetchPriority - 1);
+
+    return true;
+}
+
+bool ImageLoader::requestHistogram(const ImageFileListItem& item)
+{
+    if (_pendingHistograms.contains(item.absolutePath()))
+    {
+        return false;
+    }
+
+    // The item is on show without its histogram
+    _pendingHistograms.insert(item.absolutePath());
+    _pool.start(new HistogramTask(this, item, _generations.value(item.absolutePath(), 0)),
+                g_currentPriority);
+
+    return true;
+}
+
+bool ImageLoader::isPending(const QString& absolutePath) const
+{
+    return _pending.contains(absolutePath);
+}
+
+int ImageLoader::pendingCount() const
+{
+    return _pending.size();
+}
+
+bool ImageLoader::isCurrent(const QString& absolutePath, quint64 generation) const
+{
+    return generation == _generations.value(absolutePath, 0);
+}
+
+ImageLoader::LoadTask::LoadTask(ImageLoader* loader,
+                                const ImageFileListItem& item,
+                                quint64 generation,
+                                bool expandHistogram)
+    : QRunnable(),
+      _loader(loader),
+      _item(item),
+      _generation(generation),
+      _expandHistogram(expandHistogram)
+{
+    setAutoDelete(true);
+}
+
+ImageLoader::LoadTask::~LoadTask()
+{
+}
+
+void ImageLoader::LoadTask::run()
+{
+    QString errText;
+
+    try
+    {
+        _item.load();
+    }
+    catch (ELS::ImageLoadException* e)
+    {
+        errText = e->getErrText();
+        delete e;
+    }
+    catch (ELS::PixelVisitorTypeMismatch* e)
+    {
+        errText = e->getErrText();
+        delete e;
+    }
+    catch (...)
+    {
+        errText = "Unexpected error while loading image";
+    }
+
+    if (_item.isLoaded())
+    {
+        // So that the GUI thread only has pointers to swap: items are
+        // kept packed, and the one being shown in full as well
+        _item.packHistogram();
+        if (_expandHistogram)
+        {
+            _item.expandHistogram();
+        }
+        else
+        {
+            _item.compactHistogram();
+        }
+
+        emit _loader->loadFinished(_item, _generation);
+    }
+    else
+    {
+        if (errText.isEmpty())
+        {
+            errText = "Image could not be loaded";
+        }
+
+        emit _loader->loadFailed(_item.absolutePath(), errText, _generation);
+    }
+}
+
+ImageLoader::AlternateTask::AlternateTask(ImageLoader* loader,
+                                          const ImageFileListItem& item,
+                                          quint64 generation)
+    : QRunnable(),
+      _loader(loader),
+      _item(item),
+      _generation(generation)
+{
+    setAutoDelete(true);
+}
+
+ImageLoader::AlternateTask::~AlternateTask()
+{
+}
+
+void ImageLoader::AlternateTask::run()
+{
+    // The item was loaded once, so a failure here means the file went
+    // away under us; the toggle just takes the slow path
+    QString errText;
+    try
+    {
+        _item.renderAlternate();
+    }
+    catch (ELS::ImageLoadException* e)
+    {
+        errText = e->getErrText();
+        delete e;
+    }
+    catch (ELS::PixelVisitorTypeMismatch* e)
+    {
+        errText = e->getErrText();
+        delete e;
+    }
+    catch (...)
+    {
+        errText = "Unexpected error while rendering";
+    }
+
+    if (!errText.isEmpty())
+    {
+        fprintf(stderr, "Failed to render %s with the other stretch: %s\n",
+                qPrintable(_item.absolutePath()),
+                qPrintable(errText));
+        fflush(stderr);
+    }
+
+    emit _loader->alternateFinished(_item, _generation);
+}
+
+ImageLoader::HistogramTask::HistogramTask(ImageLoader* loader,
+                                          const ImageFileListItem& item,
+                                          quint64 generation)
+    : QRunnable(),
+      _loader(loader),
+      _item(item),
+      _generation(generation)
+{
+    setAutoDelete(true);
+}
+
+ImageLoader::HistogramTask::~HistogramTask()
+{
+}
+
+void ImageLoader::HistogramTask::run()
+{
+    _item.expandHistogram();
+
+    emit _loader->histogramFinished(_item, _generation);
+}
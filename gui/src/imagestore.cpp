@@ -0,0 +1,46 @@
+#include "imagestore.h"
+
+ImageStore::ImageStore()
+    : _items(),
+      _handles()
+{
+}
+
+ImageStore::~ImageStore()
+{
+}
+
+int ImageStore::size() const
+{
+    return (int)_items.size();
+}
+
+ImageStore::Handle ImageStore::find(const QString& absolutePath) const
+{
+    return _handles.value(absolutePath, g_noHandle);
+}
+
+ImageStore::Handle ImageStore::add(const ImageFileListItem& item)
+{
+    QHash<QString, Handle>::const_iterator i = _handles.constFind(item.absolutePath());
+    if (i != _handles.constEnd())
+    {
+        return g_noHandle;
+    }
+
+    Handle handle = (Handle)_items.size();
+    _items.push_back(item);
+    _handles.insert(item.absolutePath(), handle);
+
+    return handle;
+}
+
+ImageFileListItem& ImageStore::get(Handle handle)
+{
+    return _items[handle];
+}
+
+const ImageFileListItem& ImageStore::get(Handle handle) const
+{
+    return _items[handle];
+}
@@ -1,3 +1,6 @@
+#include <stdio.h>
+
+#include <QElapsedTimer>
 #include <QPainter>
 
 #include "imageloadexception.h"
@@ -25,7 +28,11 @@ ImageWidget::ImageWidget(QWidget* parent)
     : QWidget(parent),
       _sizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding),
       _filename(""),
-      _image(),
+      _renderer(),
+      _tiles(),
+      _lastSource(0, 0, 0, 0),
+      _reduction(1),
+      _paintTimings{0, 0, 0, 0, 0},
       _zoom(-1.0),
       _actualZoom(-1.0),
       _mouseDragLast(-1, -1),
@@ -40,6 +47,18 @@ ImageWidget::ImageWidget(QWidget* parent)
     setSizePolicy(_sizePolicy);
 
     setCursor(Qt::OpenHandCursor);
+
+    // Only the arriving tile's area is repainted, which is all a
+    // remote display has to carry
+    QObject::connect(&_tiles, &TileCache::tileReady,
+                     this, [this](quint64 rendererId, int reduction, int tileX, int tileY)
+                     {
+                         if ((_renderer != 0) && (rendererId == _renderer->getId()) && (reduction == _reduction))
+                         {
+                             TileCache::TileKey key = {rendererId, reduction, tileX, tileY};
+                             update(tileTargetRect(key).toAlignedRect() & _target);
+                         }
+                     });
 }
 
 ImageWidget::~ImageWidget()
@@ -61,9 +80,14 @@ float ImageWidget::getZoom() const
     return _zoom;
 }
 
-void ImageWidget::setImage(std::shared_ptr<const QImage> image)
+ImageWidget::PaintTimings ImageWidget::getPaintTimings() const
 {
-    _image = image;
+    return _paintTimings;
+}
+
+void ImageWidget::setImage(std::shared_ptr<const DisplayRenderer> renderer)
+{
+    _renderer = renderer;
 
     if (_zoom != -1.0)
     {
@@ -80,10 +104,12 @@ void ImageWidget::setZoom(float zoom)
     {
         zoom = adjustZoom(zoom);
     }
-    else
+    else if (_renderer != 0)
     {
+        // With nothing on show yet there's nothing to centre;
+        // setImage() fits whatever comes
         _windowZoomLockPoint = QPoint(width() / 2, height() / 2);
-        _imageZoomLockPoint = QPoint(_image->width() / 2, _image->height() / 2);
+        _imageZoomLockPoint = QPoint(_renderer->width() / 2, _renderer->height() / 2);
     }
 
     if (_zoom != zoom)
@@ -94,14 +120,19 @@ void ImageWidget::setZoom(float zoom)
 
 void ImageWidget::mouseMoveEvent(QMouseEvent* event)
 {
+    if (_renderer == 0)
+    {
+        return;
+    }
+
     if (_mouseDragLast != QPoint(-1, -1))
     {
         QPoint deltas = _mouseDragLast - event->pos();
 
         QPoint newLockPointZoomed = (_imageZoomLockPoint * _actualZoom) + deltas;
 
-        int imgZoomW = _image->width() * _actualZoom;
-        int imgZoomH = _image->height() * _actualZoom;
+        int imgZoomW = _renderer->width() * _actualZoom;
+        int imgZoomH = _renderer->height() * _actualZoom;
         newLockPointZoomed.setX(std::max(_windowZoomLockPoint.x(),
                                          std::min(imgZoomW - (_target.width() - _windowZoomLockPoint.x()),
                                                   newLockPointZoomed.x())));
@@ -112,7 +143,40 @@ void ImageWidget::mouseMoveEvent(QMouseEvent* event)
         _imageZoomLockPoint = newLockPointZoomed / _actualZoom;
 
         _mouseDragLast = event->pos();
-        update();
+
+        // When the view just slides by a whole number of window
+        // pixels, move what's on screen and repaint only the strips
+        // that scroll in. Otherwise (e.g. a zoom that leaves the
+        // pixel phase changing) repaint everything.
+        QRect oldSource = _source;
+        QRect oldTarget = _target;
+        float oldZoom = _actualZoom;
+        layoutView();
+
+        qreal scaleX = (qreal)_target.width() / _source.width();
+        qreal scaleY = (qreal)_target.height() / _source.height();
+        qreal shiftX = (oldSource.left() - _source.left()) * scaleX;
+        qreal shiftY = (oldSource.top() - _source.top()) * scaleY;
+        int dx = qRound(shiftX);
+        int dy = qRound(shiftY);
+        if ((_target == oldTarget) &&
+            (_source.size() == oldSource.size()) &&
+            (_actualZoom == oldZoom) &&
+            (qAbs(shiftX - dx) < 0.001) &&
+            (qAbs(shiftY - dy) < 0.001) &&
+            (qAbs(dx) < _target.width()) &&
+            (qAbs(dy) < _target.height()))
+        {
+            if ((dx != 0) || (dy != 0))
+            {
+                scroll(dx, dy, _target);
+                _paintTimings.scrolledFrames++;
+            }
+        }
+        else
+        {
+            update();
+        }
     }
 }
 
@@ -122,6 +186,8 @@ void ImageWidget::mousePressEvent(QMouseEvent* event)
     {
         _mouseDragLast = event->pos();
         setCursor(Qt::ClosedHandCursor);
+
+        _paintTimings = PaintTimings{0, 0, 0, 0, 0};
     }
 }
 
@@ -131,6 +197,16 @@ void ImageWidget::mouseReleaseEvent(QMouseEvent* event)
     {
         _mouseDragLast = QPoint(-1, -1);
         setCursor(Qt::OpenHandCursor);
+
+        if (_paintTimings.frames > 0)
+        {
+            printf("Drag: %lld frames painted (%lld scrolled), avg %.2f ms, max %.2f ms\n",
+                   _paintTimings.frames,
+                   _paintTimings.scrolledFrames,
+                   _paintTimings.totalUs / 1000.0 / _paintTimings.frames,
+                   _paintTimings.maxUs / 1000.0);
+            fflush(stdout);
+        }
     }
 }
 
@@ -160,136 +236,279 @@ void ImageWidget::wheelEvent(QWheelEvent* event)
     }
 }
 
-void ImageWidget::paintEvent(QPaintEvent* /* event */)
+void ImageWidget::paintEvent(QPaintEvent* event)
 {
-    if (_image != 0)
+    if (_renderer != 0)
     {
+        QElapsedTimer timer;
+        timer.start();
+
         QPainter painter(this);
 
-        int realWidth = width();
-        int realHeight = height();
+        layoutView();
 
-        if (_windowZoomLockPoint == QPoint(-1, -1))
-        {
-            _windowZoomLockPoint = QPoint(realWidth / 2, realHeight / 2);
-        }
+        painter.setRenderHints(QPainter::SmoothPixmapTransform |
+                               QPainter::Antialiasing);
+        painter.setClipRegion(event->region() & _target);
+        paintTiles(painter, event->rect());
+
+        qint64 paintUs = timer.nsecsElapsed() / 1000;
+        _paintTimings.frames++;
+        _paintTimings.lastUs = paintUs;
+        _paintTimings.totalUs += paintUs;
+        _paintTimings.maxUs = std::max(_paintTimings.maxUs, paintUs);
+    }
+}
 
-        int border = 1;
+void ImageWidget::layoutView()
+{
+    int realWidth = width();
+    int realHeight = height();
 
-        int w = realWidth - (border * 2);
-        int h = realHeight - (border * 2);
+    if (_windowZoomLockPoint == QPoint(-1, -1))
+    {
+        _windowZoomLockPoint = QPoint(realWidth / 2, realHeight / 2);
+    }
 
-        int imgW = _image->width();
-        int imgH = _image->height();
+    int border = 1;
 
-        if (_imageZoomLockPoint == QPoint(-1, -1))
-        {
-            _imageZoomLockPoint = QPoint(imgW / 2, imgH / 2);
-        }
+    int w = realWidth - (border * 2);
+    int h = realHeight - (border * 2);
 
-        int imgZoomW = imgW;
-        int imgZoomH = imgH;
-        if (_zoom != -1.0)
-        {
-            imgZoomW *= _zoom;
-            imgZoomH *= _zoom;
-        }
-        QPoint imgCenterZoom(imgZoomW / 2, imgZoomH / 2);
+    int imgW = _renderer->width();
+    int imgH = _renderer->height();
+
+    if (_imageZoomLockPoint == QPoint(-1, -1))
+    {
+        _imageZoomLockPoint = QPoint(imgW / 2, imgH / 2);
+    }
+
+    int imgZoomW = imgW;
+    int imgZoomH = imgH;
+    if (_zoom != -1.0)
+    {
+        imgZoomW *= _zoom;
+        imgZoomH *= _zoom;
+    }
+    QPoint imgCenterZoom(imgZoomW / 2, imgZoomH / 2);
 
-        _source = QRect(0, 0, imgW, imgH);
-        float zoomNow = _zoom;
-        if ((imgZoomW < w) && (imgZoomH < h))
+    _source = QRect(0, 0, imgW, imgH);
+    float zoomNow = _zoom;
+    if ((imgZoomW < w) && (imgZoomH < h))
+    {
+        _target.setLeft((w - imgZoomW) / 2);
+        _target.setTop((h - imgZoomH) / 2);
+        _target.setWidth(imgZoomW);
+        _target.setHeight(imgZoomH);
+    }
+    else
+    {
+        if (_zoom == -1.0)
         {
-            _target.setLeft((w - imgZoomW) / 2);
-            _target.setTop((h - imgZoomH) / 2);
-            _target.setWidth(imgZoomW);
-            _target.setHeight(imgZoomH);
+            float imgAspect = (float)imgW / (float)imgH;
+            float winAspect = (float)w / (float)h;
+
+            if (imgAspect >= winAspect)
+            {
+                _target.setLeft(border);
+                _target.setWidth(w);
+                int targetHeight = (int)(w / imgAspect);
+                _target.setTop((h - targetHeight) / 2 + border);
+                _target.setHeight(targetHeight);
+            }
+            else
+            {
+                _target.setTop(border);
+                _target.setHeight(h);
+                int targetWidth = (int)(h * imgAspect);
+                _target.setLeft((w - targetWidth) / 2 + border);
+                _target.setWidth(targetWidth);
+            }
+
+            zoomNow = (float)_target.width() / (float)imgW;
         }
         else
         {
-            if (_zoom == -1.0)
-            {
-                float imgAspect = (float)imgW / (float)imgH;
-                float winAspect = (float)w / (float)h;
+            int widthXtra = imgZoomW - w;
+            int heightXtra = imgZoomH - h;
 
-                if (imgAspect >= winAspect)
-                {
-                    _target.setLeft(border);
-                    _target.setWidth(w);
-                    int targetHeight = (int)(w / imgAspect);
-                    _target.setTop((h - targetHeight) / 2 + border);
-                    _target.setHeight(targetHeight);
-                }
-                else
-                {
-                    _target.setTop(border);
-                    _target.setHeight(h);
-                    int targetWidth = (int)(h * imgAspect);
-                    _target.setLeft((w - targetWidth) / 2 + border);
-                    _target.setWidth(targetWidth);
-                }
+            QPoint imgZoomLockPointZoomed = _imageZoomLockPoint * _zoom;
+            QPoint sourceZoomedTopLeft = imgZoomLockPointZoomed - _windowZoomLockPoint;
 
-                zoomNow = (float)_target.width() / (float)imgW;
+            QRect sourceZoom(0, 0, 0, 0);
+            if (widthXtra < 0)
+            {
+                _target.setLeft((w - imgZoomW) / 2 + border);
+                _target.setWidth(imgZoomW);
+                sourceZoom.setLeft(0);
+                sourceZoom.setWidth(imgZoomW);
             }
             else
             {
-                int widthXtra = imgZoomW - w;
-                int heightXtra = imgZoomH - h;
+                _target.setLeft(border);
+                _target.setWidth(w);
+                int left = std::max(0, std::min(sourceZoomedTopLeft.x(), widthXtra));
+                sourceZoom.setLeft(left);
+                sourceZoom.setWidth(w);
+            }
 
-                QPoint imgZoomLockPointZoomed = _imageZoomLockPoint * _zoom;
-                QPoint sourceZoomedTopLeft = imgZoomLockPointZoomed - _windowZoomLockPoint;
+            if (heightXtra < 0)
+            {
+                _target.setTop((h - imgZoomH) / 2 + border);
+                _target.setHeight(imgZoomH);
+                sourceZoom.setTop(0);
+                sourceZoom.setHeight(imgZoomH);
+            }
+            else
+            {
+                _target.setTop(border);
+                _target.setHeight(h);
+                int top = std::max(0, std::min(sourceZoomedTopLeft.y(), heightXtra));
+                sourceZoom.setTop(top);
+                sourceZoom.setHeight(h);
+            }
 
-                QRect sourceZoom(0, 0, 0, 0);
-                if (widthXtra < 0)
-                {
-                    _target.setLeft((w - imgZoomW) / 2 + border);
-                    _target.setWidth(imgZoomW);
-                    sourceZoom.setLeft(0);
-                    sourceZoom.setWidth(imgZoomW);
-                }
-                else
-                {
-                    _target.setLeft(border);
-                    _target.setWidth(w);
-                    int left = std::max(0, std::min(sourceZoomedTopLeft.x(), widthXtra));
-                    sourceZoom.setLeft(left);
-                    sourceZoom.setWidth(w);
-                }
+            _source.setLeft(sourceZoom.left() / _zoom);
+            _source.setWidth(sourceZoom.width() / _zoom);
+            _source.setTop(sourceZoom.top() / _zoom);
+            _source.setHeight(sourceZoom.height() / _zoom);
+        }
+    }
+
+    if (zoomNow != _actualZoom)
+    {
+        _actualZoom = zoomNow;
+
+        emit actualZoomChanged(_actualZoom);
+    }
+
+    // Render only what's visible, and when zoomed out at the largest
+    // power of two reduction the zoom allows, which comes straight
+    // from the renderer's pyramid; the painter scales the rest of the
+    // way, by less than 2x. (A zoom of -1 here means a fitted image
+    // that's shown 1:1.)
+    _reduction = 1;
+    while ((_actualZoom > 0.0f) && (_reduction * 2 * _actualZoom <= 1.0f))
+    {
+        _reduction *= 2;
+    }
+}
+
+void ImageWidget::paintTiles(QPainter& painter,
+                             const QRect& dirty)
+{
+    const int reduction = _reduction;
+    const QRect imageRect(0, 0, _renderer->width(), _renderer->height());
+    const QRect visible = _source & imageRect;
+    if (visible.isEmpty())
+    {
+        return;
+    }
+
+    const int span = TileCache::g_tileSize * reduction;
+    const int lastTileX = (imageRect.width() - 1) / span;
+    const int lastTileY = (imageRect.height() - 1) / span;
+    const int firstX = visible.left() / span;
+    const int lastX = visible.right() / span;
+    const int firstY = visible.top() / span;
+    const int lastY = visible.bottom() / span;
 
-                if (heightXtra < 0)
+    _tiles.beginRequests();
+
+    for (int tileY = firstY; tileY <= lastY; tileY++)
+    {
+        for (int tileX = firstX; tileX <= lastX; tileX++)
+        {
+            TileCache::TileKey key = {_renderer->getId(), reduction, tileX, tileY};
+            QRect tileSource = TileCache::tileSource(key) & imageRect;
+            QRectF tileTarget = tileTargetRect(key);
+
+            // Every visible tile is asked for, so the batch is whole,
+            // but only those in the damaged area are drawn
+            QImage tile = _tiles.find(key);
+            if (!tileTarget.intersects(dirty))
+            {
+                if (tile.isNull())
                 {
-                    _target.setTop((h - imgZoomH) / 2 + border);
-                    _target.setHeight(imgZoomH);
-                    sourceZoom.setTop(0);
-                    sourceZoom.setHeight(imgZoomH);
+                    _tiles.request(_renderer, key, TileCache::g_visiblePriority);
                 }
-                else
+                continue;
+            }
+
+            if (!tile.isNull())
+            {
+                painter.drawImage(tileTarget,
+                                  tile,
+                                  QRectF(0.0,
+                                         0.0,
+                                         (qreal)tileSource.width() / reduction,
+                                         (qreal)tileSource.height() / reduction));
+                continue;
+            }
+
+            _tiles.request(_renderer, key, TileCache::g_visiblePriority);
+
+            // Stand in with the part of a coarser tile that covers
+            // this one, if there is one; coarser tiles nest exactly
+            for (int coarser = reduction * 2; coarser <= reduction * 8; coarser *= 2)
+            {
+                int coarseSpan = TileCache::g_tileSize * coarser;
+                TileCache::TileKey coarseKey = {_renderer->getId(),
+                                                coarser,
+                                                tileSource.left() / coarseSpan,
+                                                tileSource.top() / coarseSpan};
+                QImage coarseTile = _tiles.find(coarseKey);
+                if (!coarseTile.isNull())
                 {
-                    _target.setTop(border);
-                    _target.setHeight(h);
-                    int top = std::max(0, std::min(sourceZoomedTopLeft.y(), heightXtra));
-                    sourceZoom.setTop(top);
-                    sourceZoom.setHeight(h);
+                    QRect coarseSource = TileCache::tileSource(coarseKey);
+                    painter.drawImage(tileTarget,
+                                      coarseTile,
+                                      QRectF((qreal)(tileSource.left() - coarseSource.left()) / coarser,
+                                             (qreal)(tileSource.top() - coarseSource.top()) / coarser,
+                                             (qreal)tileSource.width() / coarser,
+                                             (qreal)tileSource.height() / coarser));
+                    break;
                 }
-
-                _source.setLeft(sourceZoom.left() / _zoom);
-                _source.setWidth(sourceZoom.width() / _zoom);
-                _source.setTop(sourceZoom.top() / _zoom);
-                _source.setHeight(sourceZoom.height() / _zoom);
             }
         }
+    }
 
-        if (zoomNow != _actualZoom)
+    // One row or column of tiles beyond the viewport in the direction
+    // the view last moved, so they're ready as they scroll in
+    const int panX = (_source.left() > _lastSource.left()) - (_source.left() < _lastSource.left());
+    const int panY = (_source.top() > _lastSource.top()) - (_source.top() < _lastSource.top());
+    if ((_source.size() == _lastSource.size()) && ((panX != 0) || (panY != 0)))
+    {
+        int aheadX = (panX > 0) ? lastX + 1 : firstX - 1;
+        int aheadY = (panY > 0) ? lastY + 1 : firstY - 1;
+        for (int tileY = std::max(firstY - 1, 0); tileY <= std::min(lastY + 1, lastTileY); tileY++)
         {
-            _actualZoom = zoomNow;
-
-            emit actualZoomChanged(_actualZoom);
+            for (int tileX = std::max(firstX - 1, 0); tileX <= std::min(lastX + 1, lastTileX); tileX++)
+            {
+                bool isAhead = ((panX != 0) && (tileX == aheadX)) || ((panY != 0) && (tileY == aheadY));
+                if (isAhead)
+                {
+                    TileCache::TileKey key = {_renderer->getId(), reduction, tileX, tileY};
+                    _tiles.request(_renderer, key, TileCache::g_prefetchPriority);
+                }
+            }
         }
-
-        painter.setRenderHints(QPainter::SmoothPixmapTransform |
-                               QPainter::Antialiasing);
-        painter.drawImage(_target, *_image, _source);
     }
+    _lastSource = _source;
+
+    _tiles.endRequests();
+}
+
+QRectF ImageWidget::tileTargetRect(const TileCache::TileKey& key) const
+{
+    const qreal scaleX = (qreal)_target.width() / _source.width();
+    const qreal scaleY = (qreal)_target.height() / _source.height();
+    QRect tileSource = TileCache::tileSource(key) & QRect(0, 0, _renderer->width(), _renderer->height());
+
+    return QRectF(_target.left() + (tileSource.left() - _source.left()) * scaleX,
+                  _target.top() + (tileSource.top() - _source.top()) * scaleY,
+                  tileSource.width() * scaleX,
+                  tileSource.height() * scaleY);
 }
 
 void ImageWidget::_internalSetZoom(float zoom)
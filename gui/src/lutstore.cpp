@@ -0,0 +1,123 @@
+#include <algorithm>
+
+#include "lutstore.h"
+#include "parallelfor.h"
+#include "pixkernels.h"
+
+const int LutStore::g_stretchBandPoints = 65536;
+
+std::mutex LutStore::g_mutex;
+std::vector<LutStore::IdentityEntry> LutStore::g_identities;
+std::vector<LutStore::StretchEntry> LutStore::g_stretches;
+
+/* static */
+std::shared_ptr<const uint8_t[]> LutStore::getIdentity(int numPoints,
+                                                       bool isColor)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    for (size_t i = 0; i < g_identities.size(); i++)
+    {
+        if ((g_identities[i].numPoints == numPoints) && (g_identities[i].isColor == isColor))
+        {
+            return g_identities[i].lut;
+        }
+    }
+
+    const int chanCount = isColor ? 3 : 1;
+    std::shared_ptr<uint8_t[]> lut(new uint8_t[(int64_t)numPoints * chanCount]);
+    for (int i = 0; i < numPoints; i++)
+    {
+        // The top byte of the bin, so 8-bit samples come back exactly
+        // as they were (see DisplayRenderer's zero-copy path)
+        uint8_t identity = (uint8_t)(((int64_t)i * 256) / numPoints);
+        for (int chan = 0; chan < chanCount; chan++)
+        {
+            lut[(int64_t)numPoints * chan + i] = identity;
+        }
+    }
+
+    g_identities.push_back(IdentityEntry{numPoints, isColor, lut});
+    return lut;
+}
+
+/* static */
+std::shared_ptr<const uint8_t[]> LutStore::getStretch(int numPoints,
+                                                      bool isColor,
+                                                      const ELS::PixSTFParms& stfParms)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        // Forget the tables no item holds any more while looking
+        std::vector<StretchEntry>::iterator i = g_stretches.begin();
+        while (i != g_stretches.end())
+        {
+            std::shared_ptr<const uint8_t[]> lut = i->lut.lock();
+            if (lut == 0)
+            {
+                i = g_stretches.erase(i);
+                continue;
+            }
+
+            if ((i->numPoints == numPoints) && (i->isColor == isColor) && (i->stfParms == stfParms))
+            {
+                return lut;
+            }
+            ++i;
+        }
+    }
+
+    // Built unlocked, so other items' lookups don't wait on it; if
+    // another thread built the same table meanwhile, use theirs
+    std::shared_ptr<const uint8_t[]> built = buildStretch(numPoints, isColor, stfParms);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    for (size_t i = 0; i < g_stretches.size(); i++)
+    {
+        const StretchEntry& entry = g_stretches[i];
+        if ((entry.numPoints == numPoints) && (entry.isColor == isColor) && (entry.stfParms == stfParms))
+        {
+            std::shared_ptr<const uint8_t[]> lut = entry.lut.lock();
+            if (lut != 0)
+            {
+                return lut;
+            }
+        }
+    }
+
+    g_stretches.push_back(StretchEntry{numPoints, isColor, stfParms, built});
+    return built;
+}
+
+/* static */
+std::shared_ptr<const uint8_t[]> LutStore::buildStretch(int numPoints,
+                                                        bool isColor,
+                                                        const ELS::PixSTFParms& stfParms)
+{
+    const int chanCount = isColor ? 3 : 1;
+    std::shared_ptr<uint8_t[]> lut(new uint8_t[(int64_t)numPoints * chanCount]);
+
+    // Bins are spread evenly over the sample range, whatever their
+    // count (see PixUtils::getHistogramPoints)
+    const double binScale = 1.0 / (numPoints - 1);
+    const int bandsPerChan = (numPoints + g_stretchBandPoints - 1) / g_stretchBandPoints;
+    const int bandCount = bandsPerChan * chanCount;
+
+    ELS::ParallelFor::run(bandCount, [&](int /* slot */, int64_t band)
+                          {
+                              int chan = (int)band / bandsPerChan;
+                              int first = ((int)band % bandsPerChan) * g_stretchBandPoints;
+                              int count = std::min(g_stretchBandPoints, numPoints - first);
+                              ELS::PixKernels::stretchLut(first, count, binScale,
+                                                          stfParms.getSClip(chan),
+                                                          stfParms.getHClip(chan),
+                                                          stfParms.getMBal(chan),
+                                                          stfParms.getSExp(chan),
+                                                          stfParms.getHExp(chan),
+                                                          &lut[(int64_t)numPoints * chan + first]);
+                              return true;
+                          });
+
+    return lut;
+}
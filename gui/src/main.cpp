@@ -2,26 +2,44 @@
 #include <QApplication>
 #include <QDataStream>
 #include <QDir>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
 #include <QList>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <algorithm>
+#include <string.h>
 
-#include "image.h"
+#include "dirscanner.h"
 #include "imagefilelistitem.h"
 #include "mainwindow.h"
 
 int main(int argc, char* argv[])
 {
-    char error[2048];
-
     int noargc = 1;
 
-    QList<ImageFileListItem> fileList;
+    // --watch keeps loading new files from the directory arguments as
+    // they are written; --follow also jumps to each one as it lands
+    bool watch = false;
+    bool follow = false;
+
+    QList<QString> filePaths;
     QList<QDir> dirList;
     for (int i = 1; i < argc; i++)
     {
+        if (strcmp(argv[i], "--watch") == 0)
+        {
+            watch = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--follow") == 0)
+        {
+            watch = true;
+            follow = true;
+            continue;
+        }
+
         QFileInfo info(argv[i]);
         if (info.isDir())
         {
@@ -38,58 +56,50 @@ int main(int argc, char* argv[])
         }
         else
         {
-            QByteArray ba = info.absoluteFilePath().toLocal8Bit();
-            const char* absPath = ba.data();
-            ELS::Image::FileType fileType = ELS::Image::isSupportedFile(absPath, error);
-            if (fileType != ELS::Image::FT_UNKNOWN)
-            {
-                ImageFileListItem item(absPath, fileType, true);
-                if (!fileList.contains(item))
-                {
-                    fileList.append(item);
-                }
-            }
-            else
-            {
-                fprintf(stderr, "%s\n", error);
-                fflush(stderr);
-            }
-        }
-    }
-
-    QList<QDir>::iterator j;
-    for (j = dirList.begin(); j != dirList.end(); ++j)
-    {
-        QList<QFileInfo> dirFiles = j->entryInfoList(QDir::Files);
-        QList<QFileInfo>::iterator k;
-        for (k = dirFiles.begin(); k != dirFiles.end(); ++k)
-        {
-            QByteArray ba = k->absoluteFilePath().toLocal8Bit();
-            const char* absPath = ba.data();
-            ELS::Image::FileType fileType = ELS::Image::isSupportedFile(absPath, error);
-            if (fileType != ELS::Image::FT_UNKNOWN)
-            {
-                ImageFileListItem item(absPath, fileType, true);
-                if (!fileList.contains(item))
-                {
-                    fileList.append(item);
-                }
-            }
-            else
-            {
-                fprintf(stderr, "%s\n", error);
-                fflush(stderr);
-            }
+            filePaths.append(info.absoluteFilePath());
         }
     }
 
     QApplication a(noargc, argv);
+
+    // Files are validated in the background; collect until there is
+    // something to show (or, for a client, until the scan is done)
+    QList<ImageFileListItem> fileList;
+    QList<qint64> fileOrder;
+    DirScanner scanner;
+    QEventLoop scanLoop;
+    QObject::connect(&scanner, &DirScanner::finished,
+                     &scanLoop, &QEventLoop::quit);
+
     QTcpServer server;
     if (server.listen(QHostAddress::LocalHost, 2112))
     {
-        if (!fileList.isEmpty())
+        QMetaObject::Connection collect =
+            QObject::connect(&scanner, &DirScanner::fileFound,
+                             &scanLoop, [&](qint64 order, ImageFileListItem item)
+                             {
+                                 fileOrder.append(order);
+                                 fileList.append(item);
+                                 scanLoop.quit();
+                             });
+
+        scanner.scan(filePaths, dirList);
+        scanLoop.exec();
+        QObject::disconnect(collect);
+
+        // A watched folder is worth opening even before it has files
+        if (!fileList.isEmpty() || (watch && !dirList.isEmpty()))
         {
-            MainWindow w(server, fileList);
+            MainWindow w(server, fileList, fileOrder);
+
+            // The rest of the scan streams into the open window
+            QObject::connect(&scanner, &DirScanner::fileFound,
+                             &w, &MainWindow::addScannedItem);
+
+            if (watch)
+            {
+                w.watchDirs(dirList, follow);
+            }
 
             w.show();
 
@@ -98,6 +108,26 @@ int main(int argc, char* argv[])
     }
     else
     {
+        QObject::connect(&scanner, &DirScanner::fileFound,
+                         &scanLoop, [&](qint64 order, ImageFileListItem item)
+                         {
+                             fileOrder.append(order);
+                             fileList.append(item);
+                         });
+
+        scanner.scan(filePaths, dirList);
+        scanLoop.exec();
+
+        // Send them in the order a serial scan would have found them
+        QList<int> sorted;
+        for (int i = 0; i < fileList.size(); i++)
+        {
+            sorted.append(i);
+        }
+        std::sort(sorted.begin(), sorted.end(),
+                  [&](int lhs, int rhs)
+                  { return fileOrder[lhs] < fileOrder[rhs]; });
+
         QTcpSocket socket;
         socket.connectToHost("localhost", 2112);
         if (socket.waitForConnected())
@@ -107,10 +137,10 @@ int main(int argc, char* argv[])
             qint32 numFiles = fileList.size();
             out << numFiles;
 
-            QList<ImageFileListItem>::iterator i;
-            for (i = fileList.begin(); i != fileList.end(); ++i)
+            QList<int>::iterator i;
+            for (i = sorted.begin(); i != sorted.end(); ++i)
             {
-                out << *i;
+                out << fileList[*i];
             }
 
             socket.flush();
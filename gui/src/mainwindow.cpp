@@ -1,7 +1,9 @@
 #include <QApplication>
 #include <QDataStream>
+#include <QElapsedTimer>
 #include <QTcpSocket>
 
+#include <algorithm>
 #include <memory>
 
 #include "image.h"
@@ -9,14 +11,25 @@
 #include "statisticsvisitor.h"
 
 MainWindow::MainWindow(QTcpServer& server,
-                       QList<ImageFileListItem> fileList,
-                       QWidget* parent)
+                       const QList<ImageFileListItem>& items,
+                       QList<qint64> fileOrder /* = QList<qint64>() */,
+                       QWidget* parent /* = nullptr */)
     : QMainWindow(parent),
       server(server),
       clients(),
-      fileList(fileList),
+      imageStore(),
+      fileList(),
+      fileOrder(),
+      nextAppendOrder(g_appendOrderBase),
+      loader(),
+      folderWatcher(),
+      followNewest(false),
+      prefetchPolicy(),
+      imageCache(),
+      failedLoads(),
       currentFileIdx(0),
       showingStretched(false),
+      renderBothStretches(true),
       mainPane(),
       layout(&mainPane),
       imageWidget(),
@@ -36,7 +49,8 @@ MainWindow::MainWindow(QTcpServer& server,
       zoom100Btn("1:1"),
       prevBtn(" ◀ "),
       nextBtn(" ▶ "),
-      fileListPosLabel(" -- of -- ")
+      fileListPosLabel(" -- of -- "),
+      loadingBar()
 {
     const QSize iconSize(20, 20);
     const QSize btnSize(30, 30);
@@ -94,7 +108,14 @@ MainWindow::MainWindow(QTcpServer& server,
     fileListPosLabel.setMinimumHeight(height);
     fileListPosLabel.setMaximumHeight(height);
 
+    // Busy indicator while the current file loads in the background
+    loadingBar.setRange(0, 0);
+    loadingBar.setTextVisible(false);
+    loadingBar.setMaximumSize(QSize(80, height));
+    loadingBar.setVisible(false);
+
     bottomLayout.addWidget(&stretchBtn);
+    bottomLayout.addWidget(&loadingBar);
     bottomLayout.addStretch(1);
     bottomLayout.addWidget(&prevBtn);
     bottomLayout.addWidget(&fileListPosLabel);
@@ -134,6 +155,59 @@ MainWindow::MainWindow(QTcpServer& server,
                      this, &MainWindow::newConnection);
     QObject::connect(&server, &QTcpServer::acceptError,
                      this, &MainWindow::acceptError);
+    // Prefetch tuning from the environment, e.g. FAK_PREFETCH_MB=4096
+    bool ok = false;
+    int envVal = qEnvironmentVariableIntValue("FAK_PREFETCH_AHEAD", &ok);
+    if (ok)
+    {
+        prefetchPolicy.setAhead(envVal);
+    }
+    envVal = qEnvironmentVariableIntValue("FAK_PREFETCH_BEHIND", &ok);
+    if (ok)
+    {
+        prefetchPolicy.setBehind(envVal);
+    }
+    envVal = qEnvironmentVariableIntValue("FAK_PREFETCH_MB", &ok);
+    if (ok)
+    {
+        prefetchPolicy.setBudgetBytes((int64_t)envVal * 1024 * 1024);
+    }
+    envVal = qEnvironmentVariableIntValue("FAK_CACHE_MB", &ok);
+    if (ok)
+    {
+        imageCache.setBudgetBytes((int64_t)envVal * 1024 * 1024);
+    }
+    envVal = qEnvironmentVariableIntValue("FAK_STRETCH_BOTH", &ok);
+    if (ok)
+    {
+        renderBothStretches = (envVal != 0);
+    }
+
+    bool haveOrder = (fileOrder.size() == items.size());
+    for (int i = 0; i < items.size(); i++)
+    {
+        ImageStore::Handle handle = imageStore.add(items[i]);
+        if (handle != ImageStore::g_noHandle)
+        {
+            fileList.append(handle);
+            this->fileOrder.append(haveOrder ? fileOrder[i] : i);
+        }
+    }
+
+    QObject::connect(&loader, &ImageLoader::itemLoaded,
+                     this, &MainWindow::itemLoaded,
+                     Qt::QueuedConnection);
+    QObject::connect(&loader, &ImageLoader::itemFailed,
+                     this, &MainWindow::itemFailed,
+                     Qt::QueuedConnection);
+    QObject::connect(&loader, &ImageLoader::alternateRendered,
+                     this, &MainWindow::alternateRendered,
+                     Qt::QueuedConnection);
+    QObject::connect(&loader, &ImageLoader::histogramExpanded,
+                     this, &MainWindow::histogramExpanded,
+                     Qt::QueuedConnection);
+    QObject::connect(&folderWatcher, &FolderWatcher::fileReady,
+                     this, &MainWindow::watchedFileReady);
 
     syncFileIdx();
 }
@@ -158,8 +232,24 @@ void MainWindow::stretchToggled(bool isChecked)
 
         syncStretch();
 
-        fileList[currentFileIdx].setShowStretched(showingStretched);
-        imageWidget.setImage(fileList[currentFileIdx].getQImage());
+        if (!fileList.isEmpty())
+        {
+            // Set on the item even while it loads, so that itemLoaded()
+            // shows the stretch chosen here
+            ImageFileListItem& item = itemAt(currentFileIdx);
+            bool wasLoaded = item.isLoaded();
+            item.setShowStretched(showingStretched);
+            if (item.isLoaded())
+            {
+                imageWidget.setImage(item.getRenderer());
+            }
+            else if (wasLoaded)
+            {
+                // No render with this stretch yet; make one in the
+                // background with the old one left up meanwhile
+                syncFileIdx();
+            }
+        }
     }
 }
 
@@ -179,6 +269,7 @@ void MainWindow::prevClicked(bool isChecked)
 
     if (currentFileIdx > 0)
     {
+        prefetchPolicy.stepped(currentFileIdx, currentFileIdx - 1);
         currentFileIdx--;
         syncFileIdx();
     }
@@ -190,6 +281,7 @@ void MainWindow::nextClicked(bool isChecked)
 
     if ((currentFileIdx + 1) < fileList.size())
     {
+        prefetchPolicy.stepped(currentFileIdx, currentFileIdx + 1);
         currentFileIdx++;
         syncFileIdx();
     }
@@ -230,14 +322,19 @@ void MainWindow::readyRead()
             qint32 numFiles = 0;
             in >> numFiles;
 
+            bool wasEmpty = fileList.isEmpty();
             int newFileCount = 0;
             for (int i = 0; i < numFiles; i++)
             {
                 ImageFileListItem item;
                 in >> item;
-                if (!fileList.contains(item))
+                ImageStore::Handle handle = imageStore.add(item);
+                if (handle != ImageStore::g_noHandle)
                 {
-                    fileList.append(item);
+                    // Files sent by another instance go after anything
+                    // still coming from our own scan
+                    fileList.append(handle);
+                    fileOrder.append(nextAppendOrder++);
                     newFileCount++;
                     syncFileCount();
                 }
@@ -245,6 +342,11 @@ void MainWindow::readyRead()
 
             printf("Added %d files\n", newFileCount);
             fflush(stdout);
+
+            if (wasEmpty && !fileList.isEmpty())
+            {
+                syncFileIdx();
+            }
         }
     }
 }
@@ -269,45 +371,373 @@ void MainWindow::disconnected()
     }
 }
 
+void MainWindow::addScannedItem(qint64 order, ImageFileListItem item)
+{
+    ImageStore::Handle handle = imageStore.add(item);
+    if (handle == ImageStore::g_noHandle)
+    {
+        return;
+    }
+
+    int idx = std::upper_bound(fileOrder.begin(), fileOrder.end(), order) - fileOrder.begin();
+    fileOrder.insert(idx, order);
+    fileList.insert(idx, handle);
+
+    if (fileList.size() == 1)
+    {
+        syncFileIdx();
+        return;
+    }
+
+    // Keep showing the same file when one lands ahead of it
+    if (idx <= currentFileIdx)
+    {
+        currentFileIdx++;
+    }
+
+    syncFileCount();
+    prefetch();
+}
+
+void MainWindow::watchDirs(const QList<QDir>& dirs,
+                           bool followNewest)
+{
+    this->followNewest = followNewest;
+
+    QList<QDir>::const_iterator i;
+    for (i = dirs.constBegin(); i != dirs.constEnd(); ++i)
+    {
+        folderWatcher.watch(i->absolutePath());
+    }
+}
+
+void MainWindow::watchedFileReady(QString absolutePath)
+{
+    QByteArray ba = absolutePath.toLocal8Bit();
+    ELS::Image::FileType fileType = ELS::Image::fileTypeFromFilename(ba.data());
+    if (fileType == ELS::Image::FT_UNKNOWN)
+    {
+        return;
+    }
+
+    printf("New file %s\n", ba.data());
+    fflush(stdout);
+
+    // Validation, statistics and the render all happen in load() on
+    // the loader's pool
+    ImageFileListItem item(absolutePath, fileType);
+
+    int idx;
+    ImageStore::Handle handle = imageStore.find(absolutePath);
+    bool isRewrite = (handle != ImageStore::g_noHandle);
+    if (isRewrite)
+    {
+        // Whatever we had is stale, a failed load included
+        imageCache.forget(handle);
+        failedLoads.remove(absolutePath);
+        imageStore.get(handle) = item;
+        idx = fileList.indexOf(handle);
+    }
+    else
+    {
+        idx = fileList.size();
+        fileList.append(imageStore.add(item));
+        fileOrder.append(nextAppendOrder++);
+    }
+
+    bool showIt = followNewest || (fileList.size() == 1) || (idx == currentFileIdx);
+    if (isRewrite)
+    {
+        // A load still running for the path may be reading what the
+        // file held before (or a partial write); start over
+        loader.requestLoad(item,
+                           showIt ? ImageLoader::g_currentPriority : ImageLoader::g_prefetchPriority,
+                           true);
+    }
+
+    if (showIt)
+    {
+        if (idx != currentFileIdx)
+        {
+            prefetchPolicy.stepped(currentFileIdx, idx);
+        }
+        currentFileIdx = idx;
+        syncFileIdx();
+    }
+    else
+    {
+        loader.requestLoad(item, ImageLoader::g_prefetchPriority);
+        syncFileCount();
+    }
+}
+
+void MainWindow::itemLoaded(ImageFileListItem item)
+{
+    ImageStore::Handle handle = imageStore.find(item.absolutePath());
+    if (handle == ImageStore::g_noHandle)
+    {
+        return;
+    }
+
+    // The stretch may have been toggled since the load was asked for;
+    // the stored item's stretch is the one the user chose
+    ImageFileListItem& stored = imageStore.get(handle);
+    stored.adoptLoaded(item);
+    failedLoads.remove(item.absolutePath());
+    imageCache.touch(handle);
+    imageCache.enforce(imageStore, fileList[currentFileIdx]);
+
+    if (handle == fileList[currentFileIdx])
+    {
+        if (stored.isLoaded())
+        {
+            loadingBar.setVisible(false);
+            showCurrentItem();
+        }
+        else
+        {
+            // Only the other stretch came back; render this one
+            syncFileIdx();
+            return;
+        }
+    }
+
+    prefetch();
+}
+
+void MainWindow::alternateRendered(ImageFileListItem item)
+{
+    ImageStore::Handle handle = imageStore.find(item.absolutePath());
+    if (handle == ImageStore::g_noHandle)
+    {
+        return;
+    }
+
+    imageStore.get(handle).adoptAlternate(item);
+    imageCache.enforce(imageStore, fileList[currentFileIdx]);
+
+    // The toggle may have been pressed while this was rendering
+    if ((handle == fileList[currentFileIdx]) &&
+        imageStore.get(handle).isLoaded() &&
+        loadingBar.isVisible())
+    {
+        loadingBar.setVisible(false);
+        showCurrentItem();
+    }
+}
+
+void MainWindow::histogramExpanded(ImageFileListItem item)
+{
+    ImageStore::Handle handle = imageStore.find(item.absolutePath());
+    if (handle == ImageStore::g_noHandle)
+    {
+        return;
+    }
+
+    // If the user has moved on, enforce() drops it again
+    ImageFileListItem& stored = imageStore.get(handle);
+    stored.adoptHistogram(item);
+    imageCache.enforce(imageStore, fileList[currentFileIdx]);
+
+    if ((handle == fileList[currentFileIdx]) && stored.hasFullHistogram())
+    {
+        histWidget.setHistogramData(stored.isColor(),
+                                    stored.getNumHistogramPoints(),
+                                    stored.getHistogram(),
+                                    stored.getHistogramPrefixSums());
+    }
+}
+
+void MainWindow::itemFailed(QString absolutePath, QString errText)
+{
+    fprintf(stderr, "Failed to load image file '%s': %s\n",
+            qPrintable(absolutePath),
+            qPrintable(errText));
+    fflush(stderr);
+
+    failedLoads.insert(absolutePath, QFileInfo(absolutePath).lastModified());
+
+    if (!fileList.isEmpty() && (itemAt(currentFileIdx).absolutePath() == absolutePath))
+    {
+        loadingBar.setVisible(false);
+    }
+}
+
+ImageFileListItem& MainWindow::itemAt(int idx)
+{
+    return imageStore.get(fileList[idx]);
+}
+
+bool MainWindow::hasFailed(const QString& absolutePath)
+{
+    QHash<QString, QDateTime>::iterator failed = failedLoads.find(absolutePath);
+    if (failed == failedLoads.end())
+    {
+        return false;
+    }
+
+    // Rewritten since; worth another try
+    if (QFileInfo(absolutePath).lastModified() != failed.value())
+    {
+        failedLoads.erase(failed);
+        return false;
+    }
+
+    return true;
+}
+
 void MainWindow::syncFileIdx()
 {
-    ImageFileListItem* item = &(fileList[currentFileIdx]);
+    // A watched folder can start out empty
+    if (fileList.isEmpty())
+    {
+        syncFileCount();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ImageFileListItem* item = &(itemAt(currentFileIdx));
     filename = item->absolutePath();
 
-    if (!item->isLoaded())
+    syncFileCount();
+
+    imageCache.touch(fileList[currentFileIdx]);
+
+    if (item->isLoaded())
+    {
+        imageCache.recordHit();
+        loadingBar.setVisible(false);
+        showCurrentItem();
+    }
+    else
     {
+        // Leave the previous frame up until the load completes
+        imageCache.recordMiss();
         printf("Loading %s\n", qPrintable(filename));
         fflush(stdout);
-        item->load();
+        loader.requestLoad(*item, ImageLoader::g_currentPriority);
+        loadingBar.setVisible(true);
     }
 
+    prefetch();
+
+    printf("syncFileIdx: %lld ms on GUI thread; cache hits %d, misses %d, %lld MB resident\n",
+           timer.elapsed(),
+           imageCache.getHits(),
+           imageCache.getMisses(),
+           imageCache.getLastUsage() / (1024 * 1024));
+    fflush(stdout);
+}
+
+void MainWindow::showCurrentItem()
+{
+    ImageFileListItem* item = &(itemAt(currentFileIdx));
+
     minLabel.setText(item->getMin());
     meanLabel.setText(item->getMean());
     medLabel.setText(item->getMedian());
     maxLabel.setText(item->getMax());
 
-    histWidget.setHistogramData(item->isColor(),
-                                item->getNumHistogramPoints(),
-                                item->getHistogram());
+    if (item->hasFullHistogram())
+    {
+        histWidget.setHistogramData(item->isColor(),
+                                    item->getNumHistogramPoints(),
+                                    item->getHistogram(),
+                                    item->getHistogramPrefixSums());
+    }
+    else
+    {
+        // Expanded on the loader's pool; histogramExpanded() shows it
+        histWidget.setHistogramData(item->isColor(), 0, 0, 0);
+        loader.requestHistogram(*item);
+    }
 
     showingStretched = item->showStretched();
     syncStretch();
 
-    syncFileCount();
-
     printf("Setting file %d of %d: %s\n",
            currentFileIdx + 1,
            fileList.size(),
            qPrintable(filename));
     fflush(stdout);
 
-    imageWidget.setImage(fileList[currentFileIdx].getQImage());
+    imageWidget.setImage(item->getRenderer());
+
+    if (renderBothStretches && !item->hasAlternate())
+    {
+        loader.requestAlternate(*item);
+    }
+}
+
+void MainWindow::prefetch()
+{
+    if (fileList.isEmpty())
+    {
+        return;
+    }
+
+    QList<int> candidates = prefetchPolicy.getCandidates(currentFileIdx,
+                                                         fileList.size());
+
+    // Budget covers the current frame and the prefetch window; older
+    // frames are the cache's business
+    int64_t used = itemAt(currentFileIdx).getMemoryUsage();
+    int64_t estimate = used;
+    QList<int>::const_iterator i;
+    for (i = candidates.constBegin(); i != candidates.constEnd(); ++i)
+    {
+        int64_t itemUsage = itemAt(*i).getMemoryUsage();
+        used += itemUsage;
+
+        // Frames in a sequence are usually the same size, so any
+        // loaded one is a fair guess for the ones we haven't read
+        if (estimate == 0)
+        {
+            estimate = itemUsage;
+        }
+    }
+
+    // Nothing to size the budget with until the first frame is in;
+    // itemLoaded() will call back here when it arrives
+    if (estimate == 0)
+    {
+        return;
+    }
+
+    for (i = candidates.constBegin(); i != candidates.constEnd(); ++i)
+    {
+        const ImageFileListItem& item = itemAt(*i);
+        if (item.isLoaded() ||
+            loader.isPending(item.absolutePath()) ||
+            hasFailed(item.absolutePath()))
+        {
+            continue;
+        }
+
+        if ((used + estimate) > prefetchPolicy.getBudgetBytes())
+        {
+            break;
+        }
+
+        if (loader.requestLoad(item, ImageLoader::g_prefetchPriority))
+        {
+            used += estimate;
+        }
+    }
 }
 
 void MainWindow::syncFileCount()
 {
     char tmp[50];
 
+    if (fileList.isEmpty())
+    {
+        fileListPosLabel.setText(" -- of -- ");
+        return;
+    }
+
     sprintf(tmp, " %d of %d ",
             currentFileIdx + 1,
             fileList.size());
@@ -0,0 +1,103 @@
+#include <algorithm>
+
+#include "prefetchpolicy.h"
+
+/* static */
+const int PrefetchPolicy::g_defaultAhead = 3;
+/* static */
+const int PrefetchPolicy::g_defaultBehind = 1;
+/* static */
+const int64_t PrefetchPolicy::g_defaultBudgetBytes = (int64_t)2048 * 1024 * 1024;
+
+PrefetchPolicy::PrefetchPolicy(int ahead /* = g_defaultAhead */,
+                               int behind /* = g_defaultBehind */,
+                               int64_t budgetBytes /* = g_defaultBudgetBytes */)
+    : _ahead(ahead),
+      _behind(behind),
+      _budgetBytes(budgetBytes),
+      _direction(1)
+{
+}
+
+PrefetchPolicy::~PrefetchPolicy()
+{
+}
+
+int PrefetchPolicy::getAhead() const
+{
+    return _ahead;
+}
+
+int PrefetchPolicy::getBehind() const
+{
+    return _behind;
+}
+
+int64_t PrefetchPolicy::getBudgetBytes() const
+{
+    return _budgetBytes;
+}
+
+int PrefetchPolicy::getDirection() const
+{
+    return _direction;
+}
+
+void PrefetchPolicy::setAhead(int ahead)
+{
+    _ahead = std::max(0, ahead);
+}
+
+void PrefetchPolicy::setBehind(int behind)
+{
+    _behind = std::max(0, behind);
+}
+
+void PrefetchPolicy::setBudgetBytes(int64_t budgetBytes)
+{
+    _budgetBytes = std::max((int64_t)0, budgetBytes);
+}
+
+void PrefetchPolicy::stepped(int fromIdx, int toIdx)
+{
+    if (toIdx > fromIdx)
+    {
+        _direction = 1;
+    }
+    else if (toIdx < fromIdx)
+    {
+        _direction = -1;
+    }
+}
+
+QList<int> PrefetchPolicy::getCandidates(int currentIdx,
+                                         int listSize) const
+{
+    QList<int> candidates;
+
+    // Interleave so the nearest frames on both sides come before the
+    // far ones, with the direction of travel winning ties
+    int maxDistance = std::max(_ahead, _behind);
+    for (int distance = 1; distance <= maxDistance; distance++)
+    {
+        if (distance <= _ahead)
+        {
+            int idx = currentIdx + distance * _direction;
+            if ((idx >= 0) && (idx < listSize))
+            {
+                candidates.append(idx);
+            }
+        }
+
+        if (distance <= _behind)
+        {
+            int idx = currentIdx - distance * _direction;
+            if ((idx >= 0) && (idx < listSize))
+            {
+                candidates.append(idx);
+            }
+        }
+    }
+
+    return candidates;
+}
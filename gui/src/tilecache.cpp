@@ -0,0 +1,160 @@
+#include "tilecache.h"
+
+bool TileCache::TileKey::operator==(const TileKey& other) const
+{
+    return (rendererId == other.rendererId) &&
+           (reduction == other.reduction) &&
+           (tileX == other.tileX) &&
+           (tileY == other.tileY);
+}
+
+uint qHash(const TileCache::TileKey& key,
+           uint seed /* = 0 */)
+{
+    quint64 position = ((quint64)(uint32_t)key.tileX << 32) | (uint32_t)key.tileY;
+    return qHash(key.rendererId, seed) ^
+           qHash(position, seed) ^
+           qHash(key.reduction, seed);
+}
+
+TileCache::TileCache(QObject* parent /* = nullptr */)
+    : QObject(parent),
+      _pool(),
+      _tiles(),
+      _pending(),
+      _useClock(0),
+      _wantedMutex(),
+      _wanted(),
+      _batch()
+{
+    _pool.setMaxThreadCount(g_threadCount);
+
+    // Emitted from worker threads, so these arrive queued on the
+    // thread this object lives in (the GUI thread)
+    QObject::connect(this, &TileCache::tileRendered,
+                     this, [this](quint64 rendererId, int reduction, int tileX, int tileY, QImage tile)
+                     { tileFinished(TileKey{rendererId, reduction, tileX, tileY}, tile); });
+}
+
+TileCache::~TileCache()
+{
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void TileCache::beginRequests()
+{
+    _batch.clear();
+}
+
+void TileCache::endRequests()
+{
+    QMutexLocker lock(&_wantedMutex);
+    _wanted = _batch;
+}
+
+void TileCache::request(std::shared_ptr<const DisplayRenderer> renderer,
+                        const TileKey& key,
+                        int priority)
+{
+    _batch.insert(key);
+
+    if (_tiles.contains(key) || _pending.contains(key))
+    {
+        return;
+    }
+
+    // Wanted straight away, or a worker could pick it up and drop it
+    // before the batch ends
+    {
+        QMutexLocker lock(&_wantedMutex);
+        _wanted.insert(key);
+    }
+
+    _pending.insert(key);
+    _pool.start(new RenderTask(this, renderer, key), priority);
+}
+
+QImage TileCache::find(const TileKey& key)
+{
+    QHash<TileKey, Tile>::iterator i = _tiles.find(key);
+    if (i == _tiles.end())
+    {
+        return QImage();
+    }
+
+    i->lastUse = _useClock++;
+    return i->image;
+}
+
+/* static */
+QRect TileCache::tileSource(const TileKey& key)
+{
+    int span = g_tileSize * key.reduction;
+    return QRect(key.tileX * span, key.tileY * span, span, span);
+}
+
+void TileCache::tileFinished(const TileKey& key,
+                             const QImage& tile)
+{
+    _pending.remove(key);
+
+    if (tile.isNull())
+    {
+        // Dropped, but asked for again since; the repaint requeues it
+        if (isWanted(key))
+        {
+            emit tileReady(key.rendererId, key.reduction, key.tileX, key.tileY);
+        }
+        return;
+    }
+
+    _tiles.insert(key, Tile{tile, _useClock++});
+
+    while (_tiles.size() > g_maxTiles)
+    {
+        QHash<TileKey, Tile>::iterator oldest = _tiles.begin();
+        for (QHash<TileKey, Tile>::iterator i = _tiles.begin(); i != _tiles.end(); ++i)
+        {
+            if (i->lastUse < oldest->lastUse)
+            {
+                oldest = i;
+            }
+        }
+        _tiles.erase(oldest);
+    }
+
+    emit tileReady(key.rendererId, key.reduction, key.tileX, key.tileY);
+}
+
+bool TileCache::isWanted(const TileKey& key)
+{
+    QMutexLocker lock(&_wantedMutex);
+    return _wanted.contains(key);
+}
+
+TileCache::RenderTask::RenderTask(TileCache* cache,
+                                  std::shared_ptr<const DisplayRenderer> renderer,
+                                  const TileKey& key)
+    : QRunnable(),
+      _cache(cache),
+      _renderer(renderer),
+      _key(key)
+{
+    setAutoDelete(true);
+}
+
+TileCache::RenderTask::~RenderTask()
+{
+}
+
+void TileCache::RenderTask::run()
+{
+    QImage tile;
+    if (_cache->isWanted(_key))
+    {
+        tile = _renderer->render(tileSource(_key), _key.reduction);
+    }
+
+    emit _cache->tileRendered(_key.rendererId, _key.reduction, _key.tileX, _key.tileY, tile);
+}
@@ -2,6 +2,7 @@
 
 #include <fitsio.h>
 #include <inttypes.h>
+#include <vector>
 
 #include "image.h"
 #include "pixelvisitor.h"
@@ -14,6 +15,10 @@ namespace ELS
     {
     public:
         static FITSImage* load(const char* filename);
+        static Image::Info readInfo(const char* filename);
+        static void streamPixels(const char* filename,
+                                 const std::vector<PixelVisitor*>& visitors,
+                                 int bandRows);
 
     public:
         virtual ~FITSImage() override;
@@ -26,7 +31,28 @@ namespace ELS
         virtual RasterFormat getRasterFormat() const override;
         virtual SampleFormat getSampleFormat() const override;
 
-        virtual void visitPixels(PixelVisitor* visitor) const override;
+        virtual const uint8_t* getGrayBytes() const override;
+
+        virtual void detachFromFile() override;
+
+    protected:
+        virtual void visitRows(PixelVisitor* visitor,
+                               int firstRow,
+                               int lastRow,
+                               int rowStep) const override;
+
+    private:
+        // Where the data unit of a plain, uncompressed primary HDU
+        // lives in the file, and how to turn its samples into ours
+        struct MappedData
+        {
+            void* base;
+            size_t length;
+            const uint8_t* data;
+            int bitpix;
+            double bscale;
+            double bzero;
+        };
 
     private:
         FITSImage(SampleFormat sampleFormat,
@@ -35,15 +61,65 @@ namespace ELS
                   int width,
                   int height,
                   void* pixels);
+        FITSImage(SampleFormat sampleFormat,
+                  RasterFormat format,
+                  bool isColor,
+                  int width,
+                  int height,
+                  const MappedData& mapped);
+
+        template <typename PixelT>
+        void visitRows(PixelT* pixels,
+                       PixelVisitor* visitor,
+                       int firstRow,
+                       int lastRow,
+                       int rowStep) const;
+
+        template <typename PixelT>
+        void visitMappedRows(PixelVisitor* visitor,
+                             int firstRow,
+                             int lastRow,
+                             int rowStep) const;
+
+        // The whole data unit converted into our own buffer
+        template <typename PixelT>
+        PixelT* copyMappedSamples() const;
 
         template <typename PixelT>
-        void visitPixels(PixelT* pixels,
-                         PixelVisitor* visitor) const;
+        void convertMappedSamples(int64_t sampleOffset,
+                                  int64_t sampleCount,
+                                  PixelT* dest) const;
 
     private:
-        static void* readPix(fitsfile* fits,
+        static Image::Info readInfo(fitsfile* fits);
+        static void readCard(fitsfile* fits,
+                             const char* keyName,
+                             std::string* value);
+
+        template <typename PixelT>
+        static void streamBands(fitsfile* fits,
+                                int fitsIOType,
+                                const Image::Info& info,
+                                const std::vector<PixelVisitor*>& visitors,
+                                int bandRows);
+
+        static void* readPix(const char* filename,
+                             fitsfile* fits,
                              SampleFormat sampleFormat,
                              int64_t pixelCount);
+        static void freePix(SampleFormat sampleFormat,
+                            void* pixels);
+
+        static bool readTiles(const char* filename,
+                              fitsfile* fits,
+                              int fitsIOType,
+                              int bytesPerSample,
+                              void* pixels);
+
+        static bool mapDataUnit(const char* filename,
+                                fitsfile* fits,
+                                int64_t pixelCount,
+                                MappedData* mapped);
 
     private:
         SampleFormat _sampleFormat;
@@ -52,6 +128,8 @@ namespace ELS
         int _width;
         int _height;
         void* _pixels;
+        bool _isMapped;
+        MappedData _mapped;
     };
 
 }
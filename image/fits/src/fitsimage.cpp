@@ -1,26 +1,243 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <fitsio.h>
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "fitsimage.h"
 #include "fitstantrum.h"
+#include "parallelfor.h"
 
 namespace ELS
 {
 
+    // FITS data units are big-endian; these pull one sample out of a
+    // mapped data unit in host order
+    template <typename RawT>
+    static inline RawT readBigEndian(const uint8_t* src);
+
+    template <>
+    inline uint8_t readBigEndian<uint8_t>(const uint8_t* src)
+    {
+        return *src;
+    }
+
+    template <>
+    inline int16_t readBigEndian<int16_t>(const uint8_t* src)
+    {
+        uint16_t tmp;
+        memcpy(&tmp, src, sizeof(tmp));
+        return (int16_t)__builtin_bswap16(tmp);
+    }
+
+    template <>
+    inline int32_t readBigEndian<int32_t>(const uint8_t* src)
+    {
+        uint32_t tmp;
+        memcpy(&tmp, src, sizeof(tmp));
+        return (int32_t)__builtin_bswap32(tmp);
+    }
+
+    template <>
+    inline int64_t readBigEndian<int64_t>(const uint8_t* src)
+    {
+        uint64_t tmp;
+        memcpy(&tmp, src, sizeof(tmp));
+        return (int64_t)__builtin_bswap64(tmp);
+    }
+
+    template <>
+    inline float readBigEndian<float>(const uint8_t* src)
+    {
+        uint32_t tmp;
+        memcpy(&tmp, src, sizeof(tmp));
+        tmp = __builtin_bswap32(tmp);
+        float val;
+        memcpy(&val, &tmp, sizeof(val));
+        return val;
+    }
+
+    template <>
+    inline double readBigEndian<double>(const uint8_t* src)
+    {
+        uint64_t tmp;
+        memcpy(&tmp, src, sizeof(tmp));
+        tmp = __builtin_bswap64(tmp);
+        double val;
+        memcpy(&val, &tmp, sizeof(val));
+        return val;
+    }
+
+    template <typename RawT, typename PixelT>
+    static void convertSamples(const uint8_t* src,
+                               int64_t sampleCount,
+                               double bscale,
+                               double bzero,
+                               PixelT* dest)
+    {
+        if ((bscale == 1.0) && (bzero == 0.0))
+        {
+            for (int64_t i = 0; i < sampleCount; i++)
+            {
+                dest[i] = (PixelT)readBigEndian<RawT>(src + i * sizeof(RawT));
+            }
+        }
+        else
+        {
+            for (int64_t i = 0; i < sampleCount; i++)
+            {
+                dest[i] = (PixelT)(readBigEndian<RawT>(src + i * sizeof(RawT)) * bscale + bzero);
+            }
+        }
+    }
+
     /* static */
     FITSImage* FITSImage::load(const char* filename)
     {
         int status = 0;
         fitsfile* tmpFits;
 
-        fits_open_file(&tmpFits, filename, READONLY, &status);
+        fits_open_image(&tmpFits, filename, READONLY, &status);
         if (status)
         {
             throw new FITSTantrum(status);
         }
 
+        Image::Info info = readInfo(tmpFits);
+
+        int64_t pixelCount = (int64_t)info.width * info.height;
+        if (info.isColor)
+        {
+            pixelCount *= 3;
+        }
+
+        // Plain uncompressed files are mapped rather than read; pages
+        // come in as visitRows() walks the rows, until the caller
+        // copies them out with detachFromFile()
+        MappedData mapped;
+        if (mapDataUnit(filename, tmpFits, pixelCount, &mapped))
+        {
+            fits_close_file(tmpFits, &status);
+
+            return new FITSImage(info.sampleFormat,
+                                 info.rasterFormat,
+                                 info.isColor,
+                                 info.width,
+                                 info.height,
+                                 mapped);
+        }
+
+        void* pixels = readPix(filename, tmpFits, info.sampleFormat, pixelCount);
+
+        fits_close_file(tmpFits, &status);
+
+        return new FITSImage(info.sampleFormat,
+                             info.rasterFormat,
+                             info.isColor,
+                             info.width,
+                             info.height,
+                             pixels);
+    }
+
+    /* static */
+    Image::Info FITSImage::readInfo(const char* filename)
+    {
+        int status = 0;
+        fitsfile* tmpFits;
+
+        fits_open_image(&tmpFits, filename, READONLY, &status);
+        if (status)
+        {
+            throw new FITSTantrum(status);
+        }
+
+        Image::Info info;
+        try
+        {
+            info = readInfo(tmpFits);
+        }
+        catch (...)
+        {
+            fits_close_file(tmpFits, &status);
+            throw;
+        }
+
+        fits_close_file(tmpFits, &status);
+
+        return info;
+    }
+
+    /* static */
+    void FITSImage::streamPixels(const char* filename,
+                                 const std::vector<PixelVisitor*>& visitors,
+                                 int bandRows)
+    {
+        int status = 0;
+        fitsfile* tmpFits;
+
+        fits_open_image(&tmpFits, filename, READONLY, &status);
+        if (status)
+        {
+            throw new FITSTantrum(status);
+        }
+
+        try
+        {
+            Image::Info info = readInfo(tmpFits);
+
+            switch (info.sampleFormat)
+            {
+            case SF_INT_8:
+                streamBands<int8_t>(tmpFits, TSBYTE, info, visitors, bandRows);
+                break;
+            case SF_INT_16:
+                streamBands<int16_t>(tmpFits, TSHORT, info, visitors, bandRows);
+                break;
+            case SF_INT_32:
+                streamBands<int32_t>(tmpFits, TINT, info, visitors, bandRows);
+                break;
+            case SF_UINT_8:
+                streamBands<uint8_t>(tmpFits, TBYTE, info, visitors, bandRows);
+                break;
+            case SF_UINT_16:
+                streamBands<uint16_t>(tmpFits, TUSHORT, info, visitors, bandRows);
+                break;
+            case SF_UINT_32:
+                streamBands<uint32_t>(tmpFits, TUINT, info, visitors, bandRows);
+                break;
+            case SF_FLOAT:
+                streamBands<float>(tmpFits, TFLOAT, info, visitors, bandRows);
+                break;
+            case SF_DOUBLE:
+                streamBands<double>(tmpFits, TDOUBLE, info, visitors, bandRows);
+                break;
+            }
+        }
+        catch (...)
+        {
+            status = 0;
+            fits_close_file(tmpFits, &status);
+            throw;
+        }
+
+        fits_close_file(tmpFits, &status);
+    }
+
+    /* static */
+    Image::Info FITSImage::readInfo(fitsfile* fits)
+    {
+        int status = 0;
+
         int numAxis;
-        fits_get_img_dim(tmpFits, &numAxis, &status);
+        fits_get_img_dim(fits, &numAxis, &status);
         if (status)
         {
             throw new FITSTantrum(status);
@@ -32,7 +249,7 @@ namespace ELS
         }
 
         long axLengths[3];
-        fits_get_img_size(tmpFits, 3, axLengths, &status);
+        fits_get_img_size(fits, 3, axLengths, &status);
         if (status)
         {
             throw new FITSTantrum(status);
@@ -70,14 +287,8 @@ namespace ELS
             }
         }
 
-        int64_t pixelCount = width * height;
-        if (isColor)
-        {
-            pixelCount *= 3;
-        }
-
         int fitsIOSampleFormat;
-        fits_get_img_equivtype(tmpFits, &fitsIOSampleFormat, &status);
+        fits_get_img_equivtype(fits, &fitsIOSampleFormat, &status);
         if (status)
         {
             throw new FITSTantrum(status);
@@ -114,16 +325,41 @@ namespace ELS
             throw new FITSException("Unknown sample format");
         }
 
-        void* pixels = readPix(tmpFits, sampleFormat, pixelCount);
 
-        fits_close_file(tmpFits, &status);
+        Image::Info info;
+        info.fileType = FT_FITS;
+        info.width = width;
+        info.height = height;
+        info.isColor = isColor;
+        info.sampleFormat = sampleFormat;
+        info.rasterFormat = rasterFormat;
 
-        return new FITSImage(sampleFormat,
-                             rasterFormat,
-                             isColor,
-                             width,
-                             height,
-                             pixels);
+        readCard(fits, "DATE-OBS", &info.dateObs);
+        readCard(fits, "EXPTIME", &info.exposure);
+        readCard(fits, "FILTER", &info.filter);
+        readCard(fits, "OBJECT", &info.object);
+
+        return info;
+    }
+
+    /* static */
+    void FITSImage::readCard(fitsfile* fits,
+                             const char* keyName,
+                             std::string* value)
+    {
+        // Missing or unreadable cards are left empty; they're only
+        // ever shown to the user
+        int status = 0;
+        char buf[FLEN_VALUE];
+        fits_read_key(fits, TSTRING, keyName, buf, NULL, &status);
+        if (status == 0)
+        {
+            *value = buf;
+        }
+        else
+        {
+            value->clear();
+        }
     }
 
     FITSImage::FITSImage(SampleFormat sampleFormat,
@@ -137,12 +373,36 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels(pixels)
+          _pixels(pixels),
+          _isMapped(false),
+          _mapped{0, 0, 0, 0, 1.0, 0.0}
+    {
+    }
+
+    FITSImage::FITSImage(SampleFormat sampleFormat,
+                         RasterFormat format,
+                         bool isColor,
+                         int width,
+                         int height,
+                         const MappedData& mapped)
+        : _sampleFormat(sampleFormat),
+          _format(format),
+          _isColor(isColor),
+          _width(width),
+          _height(height),
+          _pixels(0),
+          _isMapped(true),
+          _mapped(mapped)
     {
     }
 
     FITSImage::~FITSImage()
     {
+        if (_isMapped)
+        {
+            munmap(_mapped.base, _mapped.length);
+        }
+
         if (_pixels != 0)
         {
             switch (_sampleFormat)
@@ -202,78 +462,167 @@ namespace ELS
         return _sampleFormat;
     }
 
-    void FITSImage::visitPixels(PixelVisitor* visitor) const
+    const uint8_t* FITSImage::getGrayBytes() const
+    {
+        if (_isColor || (_sampleFormat != SF_UINT_8))
+        {
+            return 0;
+        }
+
+        if (!_isMapped)
+        {
+            return (const uint8_t*)_pixels;
+        }
+
+        // The file's bytes are our samples only when they aren't
+        // scaled
+        if ((_mapped.bitpix == 8) && (_mapped.bscale == 1.0) && (_mapped.bzero == 0.0))
+        {
+            return _mapped.data;
+        }
+
+        return 0;
+    }
+
+    /* virtual */
+    void FITSImage::detachFromFile()
     {
+        // A mapped file that's truncated or rewritten faults on the
+        // next read of its pages and takes the process with it
+        if (!_isMapped)
+        {
+            return;
+        }
+
         switch (_sampleFormat)
         {
         case SF_INT_8:
-            visitPixels((int8_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<int8_t>();
             break;
         case SF_INT_16:
-            visitPixels((int16_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<int16_t>();
             break;
         case SF_INT_32:
-            visitPixels((int32_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<int32_t>();
             break;
         case SF_UINT_8:
-            visitPixels((uint8_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<uint8_t>();
             break;
         case SF_UINT_16:
-            visitPixels((uint16_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<uint16_t>();
             break;
         case SF_UINT_32:
-            visitPixels((uint32_t*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<uint32_t>();
             break;
         case SF_FLOAT:
-            visitPixels((float*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<float>();
             break;
         case SF_DOUBLE:
-            visitPixels((double*)_pixels,
-                        visitor);
+            _pixels = copyMappedSamples<double>();
+            break;
+        }
+
+        munmap(_mapped.base, _mapped.length);
+        _mapped = {0, 0, 0, 0, 1.0, 0.0};
+        _isMapped = false;
+    }
+
+    void FITSImage::visitRows(PixelVisitor* visitor,
+                              int firstRow,
+                              int lastRow,
+                              int rowStep) const
+    {
+        if (_isMapped)
+        {
+            switch (_sampleFormat)
+            {
+            case SF_INT_8:
+                visitMappedRows<int8_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_INT_16:
+                visitMappedRows<int16_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_INT_32:
+                visitMappedRows<int32_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_UINT_8:
+                visitMappedRows<uint8_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_UINT_16:
+                visitMappedRows<uint16_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_UINT_32:
+                visitMappedRows<uint32_t>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_FLOAT:
+                visitMappedRows<float>(visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_DOUBLE:
+                visitMappedRows<double>(visitor, firstRow, lastRow, rowStep);
+                break;
+            }
+
+            return;
+        }
+
+        switch (_sampleFormat)
+        {
+        case SF_INT_8:
+            visitRows((int8_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_INT_16:
+            visitRows((int16_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_INT_32:
+            visitRows((int32_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_UINT_8:
+            visitRows((uint8_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_UINT_16:
+            visitRows((uint16_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_UINT_32:
+            visitRows((uint32_t*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_FLOAT:
+            visitRows((float*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
+            break;
+        case SF_DOUBLE:
+            visitRows((double*)_pixels,
+                      visitor, firstRow, lastRow, rowStep);
             break;
         }
     }
 
     template <typename PixelT>
-    void FITSImage::visitPixels(PixelT* pixels,
-                                PixelVisitor* visitor) const
+    void FITSImage::visitRows(PixelT* pixels,
+                              PixelVisitor* visitor,
+                              int firstRow,
+                              int lastRow,
+                              int rowStep) const
     {
         if (!_isColor)
         {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                visitor->rowGray(y, &pixels[y * _width]);
+                visitor->rowGray(y, &pixels[(int64_t)y * _width]);
             }
-            visitor->done();
         }
         else
         {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            switch (_format)
-            {
-            case RF_INTERLEAVED:
-                visitor->rowInfo(3);
-                break;
-            case RF_PLANAR:
-                visitor->rowInfo(1);
-                break;
-            }
-            int gOffset = _width * _height;
-            int bOffset = gOffset * 2;
-            for (int y = 0; y < _height; y++)
+            int64_t gOffset = (int64_t)_width * _height;
+            int64_t bOffset = gOffset * 2;
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                int rowOffset = y * _width;
+                int64_t rowOffset = (int64_t)y * _width;
                 switch (_format)
                 {
                 case RF_INTERLEAVED:
@@ -290,12 +639,337 @@ namespace ELS
                     break;
                 }
             }
-            visitor->done();
         }
     }
 
+    template <typename PixelT>
+    void FITSImage::visitMappedRows(PixelVisitor* visitor,
+                                    int firstRow,
+                                    int lastRow,
+                                    int rowStep) const
+    {
+        int64_t planeSize = (int64_t)_width * _height;
+
+        if (!_isColor)
+        {
+            std::unique_ptr<PixelT[]> row(new PixelT[_width]);
+
+            for (int y = firstRow; y < lastRow; y += rowStep)
+            {
+                convertMappedSamples((int64_t)y * _width, _width, row.get());
+                visitor->rowGray(y, row.get());
+            }
+        }
+        else
+        {
+            std::unique_ptr<PixelT[]> row(new PixelT[_width * 3]);
+
+            switch (_format)
+            {
+            case RF_INTERLEAVED:
+                for (int y = firstRow; y < lastRow; y += rowStep)
+                {
+                    convertMappedSamples((int64_t)y * _width * 3, _width * 3, row.get());
+                    visitor->rowRgb(y,
+                                    &row[0],
+                                    &row[1],
+                                    &row[2]);
+                }
+                break;
+            case RF_PLANAR:
+                for (int y = firstRow; y < lastRow; y += rowStep)
+                {
+                    for (int chan = 0; chan < 3; chan++)
+                    {
+                        convertMappedSamples(planeSize * chan + (int64_t)y * _width,
+                                             _width,
+                                             &row[_width * chan]);
+                    }
+                    visitor->rowRgb(y,
+                                    &row[0],
+                                    &row[_width],
+                                    &row[_width * 2]);
+                }
+                break;
+            }
+        }
+    }
+
+    template <typename PixelT>
+    PixelT* FITSImage::copyMappedSamples() const
+    {
+        // The data unit is in file order, which is how readPix() lays
+        // out its samples too
+        const int64_t sampleCount = (int64_t)_width * _height * (_isColor ? 3 : 1);
+        const int64_t chunkSamples = (int64_t)_width * g_parallelChunkRows;
+        const int64_t chunkCount = (sampleCount + chunkSamples - 1) / chunkSamples;
+
+        PixelT* pixels = new PixelT[sampleCount];
+        ParallelFor::run(chunkCount, [&](int /* slot */, int64_t chunk)
+                         {
+                             int64_t first = chunk * chunkSamples;
+                             convertMappedSamples(first, std::min(chunkSamples, sampleCount - first), &pixels[first]);
+                             return true;
+                         });
+
+        return pixels;
+    }
+
+    template <typename PixelT>
+    void FITSImage::convertMappedSamples(int64_t sampleOffset,
+                                         int64_t sampleCount,
+                                         PixelT* dest) const
+    {
+        int bytesPerSample = abs(_mapped.bitpix) / 8;
+        const uint8_t* src = _mapped.data + sampleOffset * bytesPerSample;
+
+        switch (_mapped.bitpix)
+        {
+        case BYTE_IMG:
+            convertSamples<uint8_t>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        case SHORT_IMG:
+            convertSamples<int16_t>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        case LONG_IMG:
+            convertSamples<int32_t>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        case LONGLONG_IMG:
+            convertSamples<int64_t>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        case FLOAT_IMG:
+            convertSamples<float>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        case DOUBLE_IMG:
+            convertSamples<double>(src, sampleCount, _mapped.bscale, _mapped.bzero, dest);
+            break;
+        }
+    }
+
+    /* static */
+    template <typename PixelT>
+    void FITSImage::streamBands(fitsfile* fits,
+                                int fitsIOType,
+                                const Image::Info& info,
+                                const std::vector<PixelVisitor*>& visitors,
+                                int bandRows)
+    {
+        const int width = info.width;
+        const int height = info.height;
+        const int chanCount = info.isColor ? 3 : 1;
+        const int64_t bandSize = (int64_t)width * bandRows * chanCount;
+
+        // Reads rows [y0, y0 + rows) into dest. Planar color comes in
+        // one plane at a time, so dest holds rows of R, then G, then B.
+        auto readBand = [=](PixelT* dest, int y0, int rows) -> int
+        {
+            int status = 0;
+            if (!info.isColor)
+            {
+                LONGLONG fpixel[2] = {1, y0 + 1};
+                fits_read_pixll(fits, fitsIOType, fpixel, (LONGLONG)width * rows,
+                                NULL, dest, NULL, &status);
+            }
+            else if (info.rasterFormat == RF_INTERLEAVED)
+            {
+                LONGLONG fpixel[3] = {1, 1, y0 + 1};
+                fits_read_pixll(fits, fitsIOType, fpixel, (LONGLONG)width * rows * 3,
+                                NULL, dest, NULL, &status);
+            }
+            else
+            {
+                for (int chan = 0; (chan < 3) && (status == 0); chan++)
+                {
+                    LONGLONG fpixel[3] = {1, y0 + 1, chan + 1};
+                    fits_read_pixll(fits, fitsIOType, fpixel, (LONGLONG)width * rows,
+                                    NULL, &dest[(int64_t)width * rows * chan], NULL, &status);
+                }
+            }
+
+            return status;
+        };
+
+        std::vector<PixelVisitor*>::const_iterator i;
+        for (i = visitors.begin(); i != visitors.end(); ++i)
+        {
+            (*i)->pixelFormat(info.isColor ? ELS::PF_RGB : ELS::PF_GRAY);
+            (*i)->dimensions(width, height);
+            (*i)->rowInfo(info.rasterFormat == RF_INTERLEAVED && info.isColor ? 3 : 1);
+        }
+
+        // Two band buffers: the next band is read on another thread
+        // while the visitors work through the current one
+        std::unique_ptr<PixelT[]> current(new PixelT[bandSize]);
+        std::unique_ptr<PixelT[]> next(new PixelT[bandSize]);
+
+        int rows = std::min(bandRows, height);
+        int status = readBand(current.get(), 0, rows);
+        for (int y0 = 0; (status == 0) && (y0 < height); y0 += bandRows)
+        {
+            int nextY0 = y0 + bandRows;
+            int nextRows = std::min(bandRows, height - nextY0);
+            std::future<int> pending;
+            if (nextRows > 0)
+            {
+                PixelT* nextBuf = next.get();
+                pending = std::async(std::launch::async,
+                                     [=]()
+                                     { return readBand(nextBuf, nextY0, nextRows); });
+            }
+
+            const PixelT* band = current.get();
+            for (int row = 0; row < rows; row++)
+            {
+                int y = y0 + row;
+                for (i = visitors.begin(); i != visitors.end(); ++i)
+                {
+                    if (!info.isColor)
+                    {
+                        (*i)->rowGray(y, &band[(int64_t)row * width]);
+                    }
+                    else if (info.rasterFormat == RF_INTERLEAVED)
+                    {
+                        int64_t rowOffset = (int64_t)row * width * 3;
+                        (*i)->rowRgb(y,
+                                     &band[rowOffset + 0],
+                                     &band[rowOffset + 1],
+                                     &band[rowOffset + 2]);
+                    }
+                    else
+                    {
+                        int64_t planeSize = (int64_t)width * rows;
+                        int64_t rowOffset = (int64_t)row * width;
+                        (*i)->rowRgb(y,
+                                     &band[rowOffset],
+                                     &band[planeSize + rowOffset],
+                                     &band[planeSize * 2 + rowOffset]);
+                    }
+                }
+            }
+
+            if (pending.valid())
+            {
+                status = pending.get();
+                std::swap(current, next);
+            }
+            rows = nextRows;
+        }
+
+        if (status)
+        {
+            throw new FITSTantrum(status);
+        }
+
+        for (i = visitors.begin(); i != visitors.end(); ++i)
+        {
+            (*i)->done();
+        }
+    }
+
+    /* static */
+    bool FITSImage::mapDataUnit(const char* filename,
+                                fitsfile* fits,
+                                int64_t pixelCount,
+                                MappedData* mapped)
+    {
+        // cfitsio's extended filename syntax (sections, filters, etc)
+        // means the bytes on disk aren't what the caller asked for
+        if (strchr(filename, '[') != 0)
+        {
+            return false;
+        }
+
+        int status = 0;
+        int hduNum = 0;
+        fits_get_hdu_num(fits, &hduNum);
+        if (hduNum != 1)
+        {
+            return false;
+        }
+
+        if (fits_is_compressed_image(fits, &status) || status)
+        {
+            return false;
+        }
+
+        int bitpix = 0;
+        fits_get_img_type(fits, &bitpix, &status);
+
+        LONGLONG headStart = 0;
+        LONGLONG dataStart = 0;
+        LONGLONG dataEnd = 0;
+        fits_get_hduaddrll(fits, &headStart, &dataStart, &dataEnd, &status);
+        if (status)
+        {
+            return false;
+        }
+
+        double bscale = 1.0;
+        fits_read_key(fits, TDOUBLE, "BSCALE", &bscale, NULL, &status);
+        if (status == KEY_NO_EXIST)
+        {
+            status = 0;
+            bscale = 1.0;
+        }
+
+        double bzero = 0.0;
+        fits_read_key(fits, TDOUBLE, "BZERO", &bzero, NULL, &status);
+        if (status == KEY_NO_EXIST)
+        {
+            status = 0;
+            bzero = 0.0;
+        }
+
+        if (status)
+        {
+            return false;
+        }
+
+        int64_t dataSize = pixelCount * (abs(bitpix) / 8);
+
+        int fd = open(filename, O_RDONLY);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if ((fstat(fd, &st) != 0) ||
+            ((int64_t)dataStart + dataSize > (int64_t)st.st_size))
+        {
+            close(fd);
+            return false;
+        }
+
+        size_t length = (size_t)(dataStart + dataSize);
+        void* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+
+        // cfitsio quietly inflates gzip'd files; those won't have the
+        // FITS magic on disk and can't be mapped
+        if (memcmp(base, "SIMPLE", 6) != 0)
+        {
+            munmap(base, length);
+            return false;
+        }
+
+        mapped->base = base;
+        mapped->length = length;
+        mapped->data = (const uint8_t*)base + dataStart;
+        mapped->bitpix = bitpix;
+        mapped->bscale = bscale;
+        mapped->bzero = bzero;
+
+        return true;
+    }
+
     /* static */
-    void* FITSImage::readPix(fitsfile* fits,
+    void* FITSImage::readPix(const char* filename,
+                             fitsfile* fits,
                              SampleFormat sampleFormat,
                              int64_t pixelCount)
     {
@@ -342,8 +1016,22 @@ namespace ELS
             throw new FITSException("Unknown bit depth");
         }
 
-        // Read in the data in one big gulp
+        // Tile-compressed images are decompressed across cores
         int status = 0;
+        try
+        {
+            if (readTiles(filename, fits, fitsIOType, Image::getBytesPerSample(sampleFormat), pixels))
+            {
+                return pixels;
+            }
+        }
+        catch (...)
+        {
+            freePix(sampleFormat, pixels);
+            throw;
+        }
+
+        // Read in the data in one big gulp
         fits_read_pix(fits,
                       fitsIOType,
                       fpixel,
@@ -354,10 +1042,150 @@ namespace ELS
                       &status);
         if (status)
         {
+            freePix(sampleFormat, pixels);
             throw new FITSTantrum(status);
         }
 
         return pixels;
     }
 
+    /* static */
+    void FITSImage::freePix(SampleFormat sampleFormat,
+                            void* pixels)
+    {
+        switch (sampleFormat)
+        {
+        case SF_INT_8:
+            delete[](int8_t*) pixels;
+            break;
+        case SF_INT_16:
+            delete[](int16_t*) pixels;
+            break;
+        case SF_INT_32:
+            delete[](int32_t*) pixels;
+            break;
+        case SF_UINT_8:
+            delete[](uint8_t*) pixels;
+            break;
+        case SF_UINT_16:
+            delete[](uint16_t*) pixels;
+            break;
+        case SF_UINT_32:
+            delete[](uint32_t*) pixels;
+            break;
+        case SF_FLOAT:
+            delete[](float*) pixels;
+            break;
+        case SF_DOUBLE:
+            delete[](double*) pixels;
+            break;
+        }
+    }
+
+    /* static */
+    bool FITSImage::readTiles(const char* filename,
+                              fitsfile* fits,
+                              int fitsIOType,
+                              int bytesPerSample,
+                              void* pixels)
+    {
+        int status = 0;
+        if (!fits_is_compressed_image(fits, &status) || status)
+        {
+            return false;
+        }
+
+        // Worker threads each need their own handle, and cfitsio only
+        // tolerates that when built reentrant
+        if ((ParallelFor::slotCount(2) < 2) || !fits_is_reentrant())
+        {
+            return false;
+        }
+
+        int numAxis = 0;
+        long axLengths[3] = {1, 1, 1};
+        fits_get_img_dim(fits, &numAxis, &status);
+        fits_get_img_size(fits, 3, axLengths, &status);
+
+        // Rows of tiles are the unit of work so no tile is
+        // decompressed twice; fpack's default is one row per tile
+        long tileRows = 1;
+        fits_read_key(fits, TLONG, "ZTILE2", &tileRows, NULL, &status);
+        if (status == KEY_NO_EXIST)
+        {
+            status = 0;
+            tileRows = 1;
+        }
+        if (status)
+        {
+            throw new FITSTantrum(status);
+        }
+
+        const int64_t rowLen = axLengths[0];
+        const int64_t rowCount = axLengths[1];
+        const int64_t sliceCount = (numAxis == 3) ? axLengths[2] : 1;
+        const int64_t bandsPerSlice = (rowCount + tileRows - 1) / tileRows;
+        const int64_t bandCount = bandsPerSlice * sliceCount;
+
+        // A handle per slot, opened the first time the slot is used
+        std::vector<fitsfile*> slotFits(ParallelFor::slotCount(bandCount), (fitsfile*)0);
+        int firstError = 0;
+        std::mutex errorMutex;
+        auto fail = [&](int threadStatus)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (firstError == 0)
+            {
+                firstError = threadStatus;
+            }
+            return false;
+        };
+
+        ParallelFor::run(bandCount, [&](int slot, int64_t band)
+                         {
+                             int threadStatus = 0;
+                             if (slotFits[slot] == 0)
+                             {
+                                 fits_open_image(&slotFits[slot], filename, READONLY, &threadStatus);
+                                 if (threadStatus)
+                                 {
+                                     slotFits[slot] = 0;
+                                     return fail(threadStatus);
+                                 }
+                             }
+
+                             int64_t slice = band / bandsPerSlice;
+                             int64_t row = (band % bandsPerSlice) * tileRows;
+                             int64_t rows = std::min((int64_t)tileRows, rowCount - row);
+                             int64_t offset = (slice * rowCount + row) * rowLen;
+
+                             LONGLONG fpixel[3] = {1, row + 1, slice + 1};
+                             fits_read_pixll(slotFits[slot],
+                                             fitsIOType,
+                                             fpixel,
+                                             rows * rowLen,
+                                             NULL,
+                                             (uint8_t*)pixels + offset * bytesPerSample,
+                                             NULL,
+                                             &threadStatus);
+                             return threadStatus ? fail(threadStatus) : true;
+                         });
+
+        for (size_t i = 0; i < slotFits.size(); i++)
+        {
+            if (slotFits[i] != 0)
+            {
+                int closeStatus = 0;
+                fits_close_file(slotFits[i], &closeStatus);
+            }
+        }
+
+        if (firstError != 0)
+        {
+            throw new FITSTantrum(firstError);
+        }
+
+        return true;
+    }
+
 }
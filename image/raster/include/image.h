@@ -1,5 +1,9 @@
 #pragma once
 
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
 #include "pixelvisitor.h"
 #include "rastertypes.h"
 
@@ -16,6 +20,23 @@ namespace ELS
             FT_XISF
         };
 
+        // What an image is, without its pixels. The header cards are
+        // empty when the file doesn't have them.
+        struct Info
+        {
+            FileType fileType;
+            int width;
+            int height;
+            bool isColor;
+            SampleFormat sampleFormat;
+            RasterFormat rasterFormat;
+
+            std::string dateObs;
+            std::string exposure;
+            std::string filter;
+            std::string object;
+        };
+
     public:
         static Image* load(const char* filename);
         static Image* load(const char* filename,
@@ -23,6 +44,26 @@ namespace ELS
         static FileType isSupportedFile(const char* filename,
                                         char* error = 0);
 
+        static Info readInfo(const char* filename,
+                             FileType fileType);
+
+        // Validate a file and read its header in a single open, without
+        // touching pixel data. Returns FT_UNKNOWN, with the reason in
+        // error, when the file can't be loaded.
+        static FileType probe(const char* filename,
+                              Info* info,
+                              char* error = 0);
+
+        // Feed the pixels of a file to the visitors in bands of rows
+        // as they are read, without holding the whole image. Formats
+        // that can't be read incrementally are loaded and visited.
+        static void streamPixels(const char* filename,
+                                 FileType fileType,
+                                 const std::vector<PixelVisitor*>& visitors,
+                                 int bandRows = g_defaultBandRows);
+
+        static const int g_defaultBandRows;
+
     public:
         virtual ~Image();
 
@@ -34,11 +75,57 @@ namespace ELS
         virtual RasterFormat getRasterFormat() const = 0;
         virtual SampleFormat getSampleFormat() const = 0;
 
-        virtual void visitPixels(PixelVisitor* visitor) const = 0;
+        // The samples of a grey SF_UINT_8 image, when they're held in
+        // memory as width * height bytes, row 0 first, e.g. so they can
+        // be displayed without a copy; otherwise 0. They last as long
+        // as the image.
+        virtual const uint8_t* getGrayBytes() const;
+
+        // Stop reading the file the pixels came from, e.g. by copying
+        // out of a mapping, so the file can be rewritten under a live
+        // image. Call it before the image is shared between threads;
+        // pointers from getGrayBytes() don't survive it.
+        virtual void detachFromFile();
+
+        // Feed every row to the visitor, then call its done()
+        void visitPixels(PixelVisitor* visitor) const;
+
+        // Only every rowStep'th row of [firstRow, lastRow), e.g. for
+        // rendering part of the image at a reduced resolution
+        void visitPixels(PixelVisitor* visitor,
+                         int firstRow,
+                         int lastRow,
+                         int rowStep = 1) const;
+
+        // The same, with the rows split across cores when the visitor
+        // can be cloned; otherwise the same as visitPixels()
+        void visitPixelsParallel(PixelVisitor* visitor) const;
+
+        static int getBytesPerSample(SampleFormat sampleFormat);
+
+        int getBytesPerSample() const;
+        int64_t getPixelDataSize() const;
 
         const char* getImageType() const;
         const char* getSizeAndColor() const;
 
+        // From the extension alone; no I/O
+        static FileType fileTypeFromFilename(const char* filename);
+
+        static const int g_parallelChunkRows;
+
+    protected:
+        // Row calls only, for every rowStep'th row of [firstRow,
+        // lastRow); may be called from several threads at once on
+        // disjoint ranges
+        virtual void visitRows(PixelVisitor* visitor,
+                               int firstRow,
+                               int lastRow,
+                               int rowStep) const = 0;
+
+    private:
+        void startVisit(PixelVisitor* visitor) const;
+
     private:
         struct ExtInfo
         {
@@ -56,7 +143,6 @@ namespace ELS
         };
 
     private:
-        static FileType fileTypeFromFilename(const char* filename);
         static bool checkMagic(const char* filename,
                                MagicInfo* magic,
                                char* error = 0);
@@ -0,0 +1,741 @@
+#pragma once
+
+#include "pixelvisitor.h"
+#include "pixstatistics.h"
+#include "pixutils.h"
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <limits>
+#include <vector>
+
+namespace ELS
+{
+
+    // Exact median and MADN, refined from the coarse histogram of a
+    // finished StatisticsVisitor pass. Each is the rank'th smallest of
+    // a key over a channel's finite samples: the sample itself for the
+    // median, its distance from the median for the MAD. A pass keeps
+    // the keys in the range still known to hold the answer once there
+    // are at most g_selectPixelCount of them, and picks it with
+    // nth_element; until then it histograms the range, and the next
+    // pass narrows to the bin the answer is in. However the samples
+    // bunch up (e.g. 16-bit data in a 32-bit file, all of it in a few
+    // coarse bins), no more than g_selectPixelCount keys per channel
+    // are held. The median starts from the coarse histogram's bin.
+    // Images of up to g_selectPixelCount pixels skip the histograms
+    // and select straight from all the values in a single pass. NaN
+    // and infinite samples are skipped, as the coarse pass skipped
+    // them. Visit the pixels until isComplete() returns true.
+    template <typename PixelT>
+    class OrderStatisticsVisitor : public ELS::PixelVisitor
+    {
+    public:
+        OrderStatisticsVisitor(const PixStatistics<PixelT>& coarse,
+                               const uint32_t* histogram,
+                               bool isColor);
+        ~OrderStatisticsVisitor();
+
+        bool isComplete() const;
+
+        // Overwrite the median and MADN of each channel that was
+        // resolved exactly; others keep their histogram estimate
+        void getStatistics(PixStatistics<PixelT>* statistics) const;
+
+    public:
+        virtual void pixelFormat(ELS::PixelFormat pf) override;
+        virtual void dimensions(int width, int height) override;
+        virtual void rowInfo(int stride) override;
+
+        virtual void rowGray(int y,
+                             const PixelT* k) override;
+
+        virtual void rowRgb(int y,
+                            const PixelT* r,
+                            const PixelT* g,
+                            const PixelT* b) override;
+
+        virtual void done() override;
+
+        virtual PixelVisitor* clone() const override;
+        virtual void merge(const PixelVisitor* part) override;
+
+    public:
+        static const int64_t g_selectPixelCount = 1024 * 1024;
+        // Passes each statistic gets before it keeps its estimate
+        static const int g_maxPasses = 8;
+
+    private:
+        enum Pass
+        {
+            P_MEDIAN,
+            P_MAD,
+            P_COMPLETE
+        };
+
+        struct Channel
+        {
+            // Set up before the passes; rank is that of the lower
+            // median among the channel's finiteCount finite samples,
+            // or -1 if it has none
+            int64_t rank;
+            int64_t finiteCount;
+            PixelT minVal;
+            PixelT maxVal;
+
+            // The keys that can still hold the statistic being
+            // resolved: [keyLow, keyHigh), or keyLow and up when
+            // !hasKeyHigh, up to keyTop at most. candidateCount of
+            // them were counted in the last histogram; with more than
+            // g_selectPixelCount, the pass bins them at binScale
+            // rather than keeping them.
+            bool isSelecting;
+            double keyLow;
+            double keyHigh;
+            bool hasKeyHigh;
+            double keyTop;
+            double binScale;
+            int64_t candidateCount;
+            bool isBinning;
+
+            // Results
+            bool isMedResolved;
+            bool isMADResolved;
+            PixelT medVal;
+            double mad;
+
+            // Gathered by each pass; seenLow and seenHigh are the
+            // extremes of the keys in range
+            int64_t belowCount;
+            double seenLow;
+            double seenHigh;
+            bool isOverflowed;
+            std::vector<PixelT> values;
+            std::vector<double> keys;
+            std::vector<uint32_t> keyHistogram;
+        };
+
+    private:
+        OrderStatisticsVisitor(const OrderStatisticsVisitor& copyFrom);
+
+        void row(Channel* chan, const PixelT* k);
+        void gather(Channel* chan, double key);
+        void narrow(Channel* chan);
+        void setRange(Channel* chan,
+                      double keyLow,
+                      double keyHigh,
+                      bool hasKeyHigh,
+                      double keyTop,
+                      int64_t candidateCount);
+        void resolve(Channel* chan, double key);
+        void nextStatistic();
+        void startMAD(Channel* chan);
+        void selectAll(Channel* chan);
+
+        static uint32_t keyBin(const Channel* chan, double key);
+        static double lowerKey(const Channel* chan, double low, double high, uint32_t bin);
+        static double nextKey(double key);
+        static PixelT lowerBound(PixelT low, PixelT high, uint32_t bin);
+
+    private:
+        Pass _pass;
+        int _passCount;
+        bool _selectAll;
+        int _chanCount;
+        int _width;
+        int _stride;
+        Channel _chan[3];
+    };
+
+    template <typename PixelT>
+    OrderStatisticsVisitor<PixelT>::OrderStatisticsVisitor(const PixStatistics<PixelT>& coarse,
+                                                           const uint32_t* histogram,
+                                                           bool isColor)
+        : _pass(P_MEDIAN),
+          _passCount(0),
+          _selectAll(false),
+          _chanCount(isColor ? 3 : 1),
+          _width(0),
+          _stride(0),
+          _chan()
+    {
+        // Blanks can differ between channels, so each counts its own
+        const int histogramPoints = PixUtils::getHistogramPoints<PixelT>();
+        int64_t pixelCount[3] = {0, 0, 0};
+        int64_t maxPixelCount = 0;
+        for (int c = 0; c < _chanCount; c++)
+        {
+            const uint32_t* chanHistogram = &histogram[histogramPoints * c];
+            for (int i = 0; i < histogramPoints; i++)
+            {
+                pixelCount[c] += chanHistogram[i];
+            }
+            maxPixelCount = std::max(maxPixelCount, pixelCount[c]);
+        }
+
+        if (maxPixelCount == 0)
+        {
+            _pass = P_COMPLETE;
+            return;
+        }
+
+        _selectAll = maxPixelCount <= g_selectPixelCount;
+
+        for (int c = 0; c < _chanCount; c++)
+        {
+            Channel& chan = _chan[c];
+            chan.rank = pixelCount[c] > 0 ? (pixelCount[c] - 1) / 2 : -1;
+            chan.finiteCount = pixelCount[c];
+            chan.minVal = coarse.getMinVal(c);
+            chan.maxVal = coarse.getMaxVal(c);
+            chan.isSelecting = chan.rank >= 0;
+            chan.isBinning = false;
+            chan.isMedResolved = false;
+            chan.isMADResolved = false;
+            if (_selectAll || !chan.isSelecting)
+            {
+                continue;
+            }
+
+            const uint32_t* chanHistogram = &histogram[histogramPoints * c];
+            int64_t pointCount = 0;
+            int medBin = 0;
+            for (; medBin < histogramPoints - 1; medBin++)
+            {
+                pointCount += chanHistogram[medBin];
+                if (pointCount > chan.rank)
+                {
+                    break;
+                }
+            }
+
+            // The values that map into the median bin, as a range
+            // that can be tested with plain comparisons
+            PixelT binLow = lowerBound(chan.minVal, chan.maxVal, medBin);
+            bool hasBinHigh = (medBin + 1 < histogramPoints) &&
+                              (PixUtils::convertRangeToHist(chan.maxVal) > medBin);
+            PixelT binHigh = hasBinHigh ? lowerBound(binLow, chan.maxVal, medBin + 1) : chan.maxVal;
+            setRange(&chan, binLow, binHigh, hasBinHigh, chan.maxVal, chanHistogram[medBin]);
+        }
+
+        // 8 and 16-bit samples have a bin per value, so their medians
+        // are already known
+        bool isPending = false;
+        for (int c = 0; c < _chanCount; c++)
+        {
+            isPending = isPending || _chan[c].isSelecting;
+        }
+        if (!isPending)
+        {
+            nextStatistic();
+        }
+    }
+
+    template <typename PixelT>
+    OrderStatisticsVisitor<PixelT>::OrderStatisticsVisitor(const OrderStatisticsVisitor& copyFrom)
+        : _pass(copyFrom._pass),
+          _passCount(copyFrom._passCount),
+          _selectAll(copyFrom._selectAll),
+          _chanCount(copyFrom._chanCount),
+          _width(0),
+          _stride(0),
+          _chan()
+    {
+        for (int c = 0; c < _chanCount; c++)
+        {
+            // Only the setup and results; what a pass gathers starts
+            // out empty in every copy
+            Channel& chan = _chan[c];
+            const Channel& from = copyFrom._chan[c];
+            chan.rank = from.rank;
+            chan.finiteCount = from.finiteCount;
+            chan.minVal = from.minVal;
+            chan.maxVal = from.maxVal;
+            chan.isSelecting = from.isSelecting;
+            chan.keyLow = from.keyLow;
+            chan.keyHigh = from.keyHigh;
+            chan.hasKeyHigh = from.hasKeyHigh;
+            chan.keyTop = from.keyTop;
+            chan.binScale = from.binScale;
+            chan.candidateCount = from.candidateCount;
+            chan.isBinning = from.isBinning;
+            chan.isMedResolved = from.isMedResolved;
+            chan.isMADResolved = from.isMADResolved;
+            chan.medVal = from.medVal;
+            chan.mad = from.mad;
+        }
+    }
+
+    template <typename PixelT>
+    OrderStatisticsVisitor<PixelT>::~OrderStatisticsVisitor()
+    {
+    }
+
+    template <typename PixelT>
+    bool OrderStatisticsVisitor<PixelT>::isComplete() const
+    {
+        return _pass == P_COMPLETE;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::getStatistics(PixStatistics<PixelT>* statistics) const
+    {
+        for (int c = 0; c < _chanCount; c++)
+        {
+            const Channel& chan = _chan[c];
+            if (chan.isMedResolved)
+            {
+                statistics->setMedVal(c, chan.medVal);
+            }
+            if (chan.isMADResolved)
+            {
+                statistics->setMADN(c, (PixelT)(PixUtils::g_madnConstant * chan.mad));
+            }
+        }
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::pixelFormat(ELS::PixelFormat pf)
+    {
+        (void)pf;
+        for (int c = 0; c < _chanCount; c++)
+        {
+            Channel& chan = _chan[c];
+            chan.belowCount = 0;
+            chan.seenLow = std::numeric_limits<double>::infinity();
+            chan.seenHigh = -std::numeric_limits<double>::infinity();
+            chan.isOverflowed = false;
+            chan.values.clear();
+            chan.keys.clear();
+            chan.keyHistogram.clear();
+            if (chan.isSelecting && chan.isBinning)
+            {
+                chan.keyHistogram.resize(PixUtils::g_histogramPoints, 0);
+            }
+        }
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::dimensions(int width, int height)
+    {
+        _width = width;
+        (void)height;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::rowInfo(int stride)
+    {
+        _stride = stride;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::rowGray(int y,
+                                                 const PixelT* k)
+    {
+        (void)y;
+        row(&_chan[0], k);
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::rowRgb(int y,
+                                                const PixelT* r,
+                                                const PixelT* g,
+                                                const PixelT* b)
+    {
+        (void)y;
+        row(&_chan[0], r);
+        row(&_chan[1], g);
+        row(&_chan[2], b);
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::row(Channel* chan, const PixelT* k)
+    {
+        if (!chan->isSelecting)
+        {
+            return;
+        }
+
+        if (_selectAll)
+        {
+            for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+            {
+                if (PixUtils::isFinite(k[dataIdx]))
+                {
+                    chan->values.push_back(k[dataIdx]);
+                }
+            }
+        }
+        else if (_pass == P_MEDIAN)
+        {
+            for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+            {
+                if (PixUtils::isFinite(k[dataIdx]))
+                {
+                    gather(chan, (double)k[dataIdx]);
+                }
+            }
+        }
+        else if (_pass == P_MAD)
+        {
+            for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+            {
+                if (!PixUtils::isFinite(k[dataIdx]))
+                {
+                    continue;
+                }
+
+                double dev = (double)k[dataIdx] - (double)chan->medVal;
+                gather(chan, dev < 0 ? -dev : dev);
+            }
+        }
+    }
+
+    template <typename PixelT>
+    inline void OrderStatisticsVisitor<PixelT>::gather(Channel* chan, double key)
+    {
+        if (key < chan->keyLow)
+        {
+            chan->belowCount++;
+            return;
+        }
+        if (chan->hasKeyHigh && (key >= chan->keyHigh))
+        {
+            return;
+        }
+
+        chan->seenLow = std::min(chan->seenLow, key);
+        chan->seenHigh = std::max(chan->seenHigh, key);
+        if (chan->isBinning)
+        {
+            chan->keyHistogram[keyBin(chan, key)]++;
+        }
+        else if ((int64_t)chan->keys.size() < g_selectPixelCount)
+        {
+            chan->keys.push_back(key);
+        }
+        else
+        {
+            chan->isOverflowed = true;
+        }
+    }
+
+    template <typename PixelT>
+    PixelVisitor* OrderStatisticsVisitor<PixelT>::clone() const
+    {
+        return new OrderStatisticsVisitor<PixelT>(*this);
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::merge(const PixelVisitor* part)
+    {
+        const OrderStatisticsVisitor<PixelT>* other = static_cast<const OrderStatisticsVisitor<PixelT>*>(part);
+        for (int c = 0; c < _chanCount; c++)
+        {
+            Channel& chan = _chan[c];
+            const Channel& from = other->_chan[c];
+            chan.belowCount += from.belowCount;
+            chan.seenLow = std::min(chan.seenLow, from.seenLow);
+            chan.seenHigh = std::max(chan.seenHigh, from.seenHigh);
+            chan.values.insert(chan.values.end(), from.values.begin(), from.values.end());
+
+            // The bound holds across the parts too
+            chan.isOverflowed = chan.isOverflowed || from.isOverflowed ||
+                                ((int64_t)(chan.keys.size() + from.keys.size()) > g_selectPixelCount);
+            if (chan.isOverflowed)
+            {
+                chan.keys = std::vector<double>();
+            }
+            else
+            {
+                chan.keys.insert(chan.keys.end(), from.keys.begin(), from.keys.end());
+            }
+
+            for (size_t i = 0; i < chan.keyHistogram.size(); i++)
+            {
+                chan.keyHistogram[i] += from.keyHistogram[i];
+            }
+        }
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::done()
+    {
+        bool isPending = false;
+        for (int c = 0; c < _chanCount; c++)
+        {
+            Channel& chan = _chan[c];
+            if (_selectAll)
+            {
+                selectAll(&chan);
+            }
+            else if (chan.isSelecting)
+            {
+                narrow(&chan);
+                isPending = isPending || chan.isSelecting;
+            }
+
+            // Release what was gathered; only the results are kept
+            chan.values = std::vector<PixelT>();
+            chan.keys = std::vector<double>();
+            chan.keyHistogram = std::vector<uint32_t>();
+        }
+
+        if (isPending && (++_passCount < g_maxPasses))
+        {
+            return;
+        }
+
+        nextStatistic();
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::narrow(Channel* chan)
+    {
+        // The coarse histogram's range is only as good as lowerBound()
+        // could make it, so check that the answer really is in range
+        int64_t localRank = chan->rank - chan->belowCount;
+        if (chan->isOverflowed || (localRank < 0))
+        {
+            chan->isSelecting = false;
+            return;
+        }
+
+        if (!chan->isBinning)
+        {
+            if (localRank >= (int64_t)chan->keys.size())
+            {
+                chan->isSelecting = false;
+                return;
+            }
+
+            std::nth_element(chan->keys.begin(), chan->keys.begin() + localRank, chan->keys.end());
+            resolve(chan, chan->keys[localRank]);
+            return;
+        }
+
+        int64_t pointCount = 0;
+        uint32_t bin = 0;
+        for (; bin < (uint32_t)PixUtils::g_histogramPoints; bin++)
+        {
+            pointCount += chan->keyHistogram[bin];
+            if (pointCount > localRank)
+            {
+                break;
+            }
+        }
+        if (bin == (uint32_t)PixUtils::g_histogramPoints)
+        {
+            chan->isSelecting = false;
+            return;
+        }
+
+        // e.g. a clipped background, which no bin can split
+        if (chan->seenLow == chan->seenHigh)
+        {
+            resolve(chan, chan->seenLow);
+            return;
+        }
+
+        double low = lowerKey(chan, chan->keyLow, chan->keyTop, bin);
+        double high = chan->keyHigh;
+        bool hasHigh = chan->hasKeyHigh;
+        if ((bin + 1 < (uint32_t)PixUtils::g_histogramPoints) && (keyBin(chan, chan->keyTop) > bin))
+        {
+            high = lowerKey(chan, low, chan->keyTop, bin + 1);
+            hasHigh = true;
+        }
+        setRange(chan, low, high, hasHigh, chan->keyTop, chan->keyHistogram[bin]);
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::setRange(Channel* chan,
+                                                  double keyLow,
+                                                  double keyHigh,
+                                                  bool hasKeyHigh,
+                                                  double keyTop,
+                                                  int64_t candidateCount)
+    {
+        chan->keyLow = keyLow;
+        chan->keyHigh = keyHigh;
+        chan->hasKeyHigh = hasKeyHigh;
+        chan->keyTop = hasKeyHigh ? keyHigh : keyTop;
+        chan->candidateCount = candidateCount;
+
+        // A range with room for one key holds the answer
+        if (hasKeyHigh ? (nextKey(keyLow) >= keyHigh) : (keyLow >= keyTop))
+        {
+            resolve(chan, keyLow);
+            return;
+        }
+
+        chan->binScale = PixUtils::g_histogramPoints / (chan->keyTop - keyLow);
+        chan->isBinning = candidateCount > g_selectPixelCount;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::resolve(Channel* chan, double key)
+    {
+        if (_pass == P_MEDIAN)
+        {
+            chan->medVal = (PixelT)key;
+            chan->isMedResolved = true;
+        }
+        else
+        {
+            chan->mad = key;
+            chan->isMADResolved = true;
+        }
+        chan->isSelecting = false;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::nextStatistic()
+    {
+        // Channels that are still selecting keep their estimate
+        _passCount = 0;
+        bool isPending = false;
+        for (int c = 0; c < _chanCount; c++)
+        {
+            Channel& chan = _chan[c];
+            chan.isSelecting = false;
+            if ((_pass == P_MEDIAN) && !_selectAll && chan.isMedResolved)
+            {
+                startMAD(&chan);
+                isPending = isPending || chan.isSelecting;
+            }
+        }
+
+        _pass = isPending ? P_MAD : P_COMPLETE;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::startMAD(Channel* chan)
+    {
+        // Resolved in the MAD pass, so resolve() sees P_MAD
+        Pass pass = _pass;
+        _pass = P_MAD;
+
+        double devTop = std::max((double)chan->medVal - (double)chan->minVal,
+                                 (double)chan->maxVal - (double)chan->medVal);
+        chan->isSelecting = true;
+        setRange(chan, 0.0, 0.0, false, devTop, chan->finiteCount);
+
+        _pass = pass;
+    }
+
+    template <typename PixelT>
+    void OrderStatisticsVisitor<PixelT>::selectAll(Channel* chan)
+    {
+        if ((chan->rank < 0) || (chan->rank >= (int64_t)chan->values.size()))
+        {
+            return;
+        }
+
+        std::nth_element(chan->values.begin(), chan->values.begin() + chan->rank, chan->values.end());
+        chan->medVal = chan->values[chan->rank];
+        chan->isMedResolved = true;
+
+        std::vector<double> deviations(chan->values.size());
+        for (size_t i = 0; i < chan->values.size(); i++)
+        {
+            double dev = (double)chan->values[i] - (double)chan->medVal;
+            deviations[i] = dev < 0 ? -dev : dev;
+        }
+
+        std::nth_element(deviations.begin(), deviations.begin() + chan->rank, deviations.end());
+        chan->mad = deviations[chan->rank];
+        chan->isMADResolved = true;
+    }
+
+    /* static */
+    template <typename PixelT>
+    inline uint32_t OrderStatisticsVisitor<PixelT>::keyBin(const Channel* chan, double key)
+    {
+        // Clamped in double, so that no bin is out of range even where
+        // the scaled key overflows an int
+        const double lastBin = PixUtils::g_histogramPoints - 1;
+        double bin = (key - chan->keyLow) * chan->binScale;
+        return (uint32_t)(bin < lastBin ? bin : lastBin);
+    }
+
+    /* static */
+    template <typename PixelT>
+    double OrderStatisticsVisitor<PixelT>::lowerKey(const Channel* chan, double low, double high, uint32_t bin)
+    {
+        // Bisect for the smallest key that lands in bin or above. Keys
+        // of integer samples are whole numbers, medians and deviations
+        // alike.
+        if (keyBin(chan, low) >= bin)
+        {
+            return low;
+        }
+
+        for (;;)
+        {
+            double mid = low + (high - low) / 2;
+            if (std::numeric_limits<PixelT>::is_integer)
+            {
+                mid = std::floor(mid);
+            }
+            if ((mid <= low) || (mid >= high))
+            {
+                break;
+            }
+
+            if (keyBin(chan, mid) < bin)
+            {
+                low = mid;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        return high;
+    }
+
+    /* static */
+    template <typename PixelT>
+    double OrderStatisticsVisitor<PixelT>::nextKey(double key)
+    {
+        if (std::numeric_limits<PixelT>::is_integer)
+        {
+            return key + 1;
+        }
+        return std::nextafter(key, std::numeric_limits<double>::infinity());
+    }
+
+    /* static */
+    template <typename PixelT>
+    PixelT OrderStatisticsVisitor<PixelT>::lowerBound(PixelT low, PixelT high, uint32_t bin)
+    {
+        // Bisect for the smallest value that maps into bin or above
+        if (PixUtils::convertRangeToHist(low) >= bin)
+        {
+            return low;
+        }
+
+        for (int i = 0; i < 128; i++)
+        {
+            PixelT mid = (PixelT)((double)low + ((double)high - (double)low) / 2);
+            if ((mid == low) || (mid == high))
+            {
+                break;
+            }
+
+            if (PixUtils::convertRangeToHist(mid) < bin)
+            {
+                low = mid;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        return high;
+    }
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <inttypes.h>
+
+namespace ELS
+{
+
+    // Loops spread across cores through one pool of worker threads
+    // for the whole process, one fewer than there are cores. The
+    // caller always works through the items too, so a run() never
+    // waits on the pool, and runs started from inside other runs (or
+    // from many loader threads at once) share the same workers rather
+    // than each starting a thread per core.
+    class ParallelFor
+    {
+    public:
+        // The most threads run() would use for count items, and so
+        // the number of slots it hands out
+        static int slotCount(int64_t count);
+
+        // Call work(slot, i) for each i in [0, count). Calls with the
+        // same slot, in [0, slotCount(count)), never overlap, so state
+        // kept per slot needs no locking; slot 0 is the caller's
+        // thread. Once work returns false no more items are started
+        // and run() returns false. An exception thrown by work stops
+        // it the same way and is rethrown here.
+        static bool run(int64_t count,
+                        const std::function<bool(int, int64_t)>& work);
+    };
+
+}
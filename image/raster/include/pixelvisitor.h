@@ -9,6 +9,8 @@ namespace ELS
     class PixelVisitor
     {
     public:
+        virtual ~PixelVisitor();
+
         virtual void pixelFormat(ELS::PixelFormat pf) = 0;
         virtual void dimensions(int width, int height) = 0;
         virtual void rowInfo(int stride) = 0;
@@ -64,6 +66,15 @@ namespace ELS
                             const double* b);
 
         virtual void done() = 0;
+
+        // Parallel traversal (Image::visitPixelsParallel). A visitor
+        // that can work on a subset of the rows returns a new copy of
+        // itself here, which the caller deletes. Each copy gets the
+        // same setup calls and some of the rows, then is merged back
+        // into the original before done() is called on the original
+        // alone. The default can't be split and returns 0.
+        virtual PixelVisitor* clone() const;
+        virtual void merge(const PixelVisitor* part);
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <inttypes.h>
+
+namespace ELS
+{
+
+    // Vectorised inner loops for the pixel visitors. Each kernel is
+    // built for AVX-512, AVX2 and baseline x86-64, and the best one
+    // the CPU supports is picked at load time, so the same binary runs
+    // on older machines.
+    class PixKernels
+    {
+    public:
+        // Fold count samples, stride apart, into the running min, max
+        // and sum, and return how many were folded in. Non-finite
+        // floating point samples are skipped. The min and max must
+        // already be seeded (e.g. with the type's max and lowest).
+        static int minMaxSum(const int8_t* k, int count, int stride,
+                             int8_t* minVal, int8_t* maxVal, double* sum);
+        static int minMaxSum(const int16_t* k, int count, int stride,
+                             int16_t* minVal, int16_t* maxVal, double* sum);
+        static int minMaxSum(const int32_t* k, int count, int stride,
+                             int32_t* minVal, int32_t* maxVal, double* sum);
+        static int minMaxSum(const uint8_t* k, int count, int stride,
+                             uint8_t* minVal, uint8_t* maxVal, double* sum);
+        static int minMaxSum(const uint16_t* k, int count, int stride,
+                             uint16_t* minVal, uint16_t* maxVal, double* sum);
+        static int minMaxSum(const uint32_t* k, int count, int stride,
+                             uint32_t* minVal, uint32_t* maxVal, double* sum);
+        static int minMaxSum(const float* k, int count, int stride,
+                             float* minVal, float* maxVal, double* sum);
+        static int minMaxSum(const double* k, int count, int stride,
+                             double* minVal, double* maxVal, double* sum);
+
+        // Map count samples, stride apart, through a display LUT
+        // indexed by histogram bin (as PixUtils::convertRangeToHist)
+        // and write them to out as 8-bit grey.
+        static void renderGray(const int8_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const int16_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const int32_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const uint8_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const uint16_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const uint32_t* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const float* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+        static void renderGray(const double* k, int count, int stride,
+                               const uint8_t* lut, uint8_t* out);
+
+        // As renderGray, for colour: a byte LUT per channel, with the
+        // result packed to opaque ARGB32
+        static void renderRgb(const int8_t* r, const int8_t* g, const int8_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const int16_t* r, const int16_t* g, const int16_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const int32_t* r, const int32_t* g, const int32_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const uint16_t* r, const uint16_t* g, const uint16_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const uint32_t* r, const uint32_t* g, const uint32_t* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const float* r, const float* g, const float* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+        static void renderRgb(const double* r, const double* g, const double* b,
+                              int count, int stride, const uint8_t* rLut,
+                              const uint8_t* gLut, const uint8_t* bLut, uint32_t* out);
+
+        // Box filter two rows of ARGB32 down by 2x in each direction:
+        // each of the count output pixels is the rounded mean of a 2x2
+        // block, per channel. The rows must hold 2 * count pixels.
+        static void halveArgb(const uint32_t* row0, const uint32_t* row1,
+                              int count, uint32_t* out);
+        // The same for 8-bit grey
+        static void halveGray(const uint8_t* row0, const uint8_t* row1,
+                              int count, uint8_t* out);
+
+        // Fill count entries of a display LUT from bin first on with
+        // the screen transfer function (as PixUtils::screenTransferFunc)
+        // of bin * binScale, scaled to a byte
+        static void stretchLut(int first, int count, double binScale,
+                               double sClip, double hClip, double mBal,
+                               double sExp, double hExp, uint8_t* out);
+    };
+
+}
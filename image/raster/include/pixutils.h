@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <inttypes.h>
 #include "pixstfparms.h"
 
@@ -41,27 +42,43 @@ namespace ELS
                                          PixSTFParms* stfParms,
                                          int chan = 0);
 
-        static uint16_t convertRangeToHist(int8_t val);
-        static uint16_t convertRangeToHist(int16_t val);
-        static uint16_t convertRangeToHist(int32_t val);
-        static uint16_t convertRangeToHist(uint8_t val);
-        static uint16_t convertRangeToHist(uint16_t val);
-        static uint16_t convertRangeToHist(uint32_t val);
-        static uint16_t convertRangeToHist(float val);
-        static uint16_t convertRangeToHist(double val);
-
-        static void convertRangeFromHist(uint16_t hist, int8_t* val);
-        static void convertRangeFromHist(uint16_t hist, int16_t* val);
-        static void convertRangeFromHist(uint16_t hist, int32_t* val);
-        static void convertRangeFromHist(uint16_t hist, uint8_t* val);
-        static void convertRangeFromHist(uint16_t hist, uint16_t* val);
-        static void convertRangeFromHist(uint16_t hist, uint32_t* val);
-        static void convertRangeFromHist(uint16_t hist, float* val);
-        static void convertRangeFromHist(uint16_t hist, double* val);
+        static uint32_t convertRangeToHist(int8_t val);
+        static uint32_t convertRangeToHist(int16_t val);
+        static uint32_t convertRangeToHist(int32_t val);
+        static uint32_t convertRangeToHist(uint8_t val);
+        static uint32_t convertRangeToHist(uint16_t val);
+        static uint32_t convertRangeToHist(uint32_t val);
+        static uint32_t convertRangeToHist(float val);
+        static uint32_t convertRangeToHist(double val);
+
+        static void convertRangeFromHist(uint32_t hist, int8_t* val);
+        static void convertRangeFromHist(uint32_t hist, int16_t* val);
+        static void convertRangeFromHist(uint32_t hist, int32_t* val);
+        static void convertRangeFromHist(uint32_t hist, uint8_t* val);
+        static void convertRangeFromHist(uint32_t hist, uint16_t* val);
+        static void convertRangeFromHist(uint32_t hist, uint32_t* val);
+        static void convertRangeFromHist(uint32_t hist, float* val);
+        static void convertRangeFromHist(uint32_t hist, double* val);
+
+        // Histogram bins per channel for samples of type PixelT, and so
+        // the size of the display LUTs indexed by convertRangeToHist
+        template <typename PixelT>
+        static int getHistogramPoints();
+
+        // False for NaN and infinite samples, which the statistics
+        // leave out; always true for integers
+        template <typename PixelT>
+        static bool isFinite(PixelT pixel);
 
     public:
+        // 8-bit samples get a bin per value, 16-bit ones too. Wider
+        // integers keep their top g_wideHistogramBits bits, and
+        // floating point is cut into as many bins over [0, 1].
+        static const int g_byteHistogramPoints;
         static const int g_histogramPoints;
-        static const int g_histogramRangeMax;
+        static const int g_wideHistogramBits = 20;
+        static const int g_wideHistogramPoints;
+        static const int g_wideHistogramRangeMax;
 
         static const double g_madnConstant;
 
@@ -75,6 +92,63 @@ namespace ELS
         static const uint32_t g_u32Mid;
     };
 
+    /* static */
+    template <typename PixelT>
+    int PixUtils::getHistogramPoints()
+    {
+        return g_wideHistogramPoints;
+    }
+
+    /* static */
+    template <>
+    inline int PixUtils::getHistogramPoints<int8_t>()
+    {
+        return g_byteHistogramPoints;
+    }
+
+    /* static */
+    template <>
+    inline int PixUtils::getHistogramPoints<uint8_t>()
+    {
+        return g_byteHistogramPoints;
+    }
+
+    /* static */
+    template <>
+    inline int PixUtils::getHistogramPoints<int16_t>()
+    {
+        return g_histogramPoints;
+    }
+
+    /* static */
+    template <>
+    inline int PixUtils::getHistogramPoints<uint16_t>()
+    {
+        return g_histogramPoints;
+    }
+
+    /* static */
+    template <typename PixelT>
+    inline bool PixUtils::isFinite(PixelT pixel)
+    {
+        (void)pixel;
+        return true;
+    }
+
+    /* static */
+    template <>
+    inline bool PixUtils::isFinite<float>(float pixel)
+    {
+        return std::isfinite(pixel);
+    }
+
+    /* static */
+    template <>
+    inline bool PixUtils::isFinite<double>(double pixel)
+    {
+        return std::isfinite(pixel);
+    }
+
     /* static */
     template <typename PixelT>
     double PixUtils::screenTransferFunc(PixelT pixel,
@@ -1,14 +1,20 @@
 #pragma once
 
 #include "pixelvisitor.h"
+#include "pixkernels.h"
 #include "pixstatistics.h"
 #include "pixutils.h"
 #include <inttypes.h>
+#include <limits>
 #include <memory>
 
 namespace ELS
 {
 
+    // Min, max, mean and a histogram per channel, from which the
+    // median and MADN are estimated. NaN and infinite samples are left
+    // out of all of it, so channels can count different numbers of
+    // pixels.
     template <typename PixelT>
     class StatisticsVisitor : public ELS::PixelVisitor
     {
@@ -36,12 +42,14 @@ namespace ELS
 
         virtual void done() override;
 
+        virtual PixelVisitor* clone() const override;
+        virtual void merge(const PixelVisitor* part) override;
+
     private:
         bool _isColor;
         int _width;
         int _stride;
-        bool _isFirstPixel;
-        int64_t _pixelCount;
+        int64_t _pixelCount[3];
         std::shared_ptr<uint32_t[]> _histogram;
         double _accumulator[3];
         PixelT _minVal[3];
@@ -54,7 +62,7 @@ namespace ELS
         : _isColor(false),
           _width(0),
           _stride(0),
-          _isFirstPixel(true),
+          _pixelCount{0, 0, 0},
           _histogram(0),
           _accumulator{0.0, 0.0, 0.0},
           _minVal{0, 0, 0},
@@ -78,21 +86,24 @@ namespace ELS
     void StatisticsVisitor<PixelT>::getHistogramData(int* numPoints,
                                                      std::shared_ptr<uint32_t[]>* data)
     {
-        *numPoints = PixUtils::g_histogramPoints;
+        *numPoints = PixUtils::getHistogramPoints<PixelT>();
         *data = _histogram;
     }
 
     template <typename PixelT>
     void StatisticsVisitor<PixelT>::pixelFormat(ELS::PixelFormat pf)
     {
-        int totalHistogramPoints = PixUtils::g_histogramPoints;
+        const int histogramPoints = PixUtils::getHistogramPoints<PixelT>();
+        int totalHistogramPoints = histogramPoints;
         _isColor = pf != ELS::PF_GRAY;
 
-        _isFirstPixel = true;
-        _accumulator[0] = 0;
-        _accumulator[1] = 0;
-        _accumulator[2] = 0;
-        _pixelCount = 0;
+        for (int chan = 0; chan < 3; chan++)
+        {
+            _accumulator[chan] = 0;
+            _pixelCount[chan] = 0;
+            _minVal[chan] = std::numeric_limits<PixelT>::max();
+            _maxVal[chan] = std::numeric_limits<PixelT>::lowest();
+        }
 
         if (_isColor)
         {
@@ -100,13 +111,13 @@ namespace ELS
         }
 
         _histogram = std::shared_ptr<uint32_t[]>(new uint32_t[totalHistogramPoints]);
-        for (int i = 0; i < PixUtils::g_histogramPoints; i++)
+        for (int i = 0; i < histogramPoints; i++)
         {
             _histogram[i] = 0;
             if (_isColor)
             {
-                _histogram[PixUtils::g_histogramPoints + i] = 0;
-                _histogram[PixUtils::g_histogramPoints * 2 + i] = 0;
+                _histogram[histogramPoints + i] = 0;
+                _histogram[histogramPoints * 2 + i] = 0;
             }
         }
     }
@@ -129,31 +140,19 @@ namespace ELS
                                             const PixelT* k)
     {
         (void)y;
-        for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+        if (_width <= 0)
         {
-            _pixelCount++;
+            return;
+        }
 
-            if (_isFirstPixel)
-            {
-                _isFirstPixel = false;
-                _minVal[0] = k[dataIdx];
-                _maxVal[0] = k[dataIdx];
-            }
-            else
+        _pixelCount[0] += PixKernels::minMaxSum(k, _width, _stride, &_minVal[0], &_maxVal[0], &_accumulator[0]);
+
+        for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+        {
+            if (PixUtils::isFinite(k[dataIdx]))
             {
-                if (k[dataIdx] < _minVal[0])
-                {
-                    _minVal[0] = k[dataIdx];
-                }
-                if (k[dataIdx] > _maxVal[0])
-                {
-                    _maxVal[0] = k[dataIdx];
-                }
+                _histogram[PixUtils::convertRangeToHist(k[dataIdx])]++;
             }
-
-            _accumulator[0] += k[dataIdx];
-
-            _histogram[PixUtils::convertRangeToHist(k[dataIdx])]++;
         }
     }
 
@@ -164,89 +163,96 @@ namespace ELS
                                            const PixelT* b)
     {
         (void)y;
-        for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
+        if (_width <= 0)
         {
-            _pixelCount++;
+            return;
+        }
 
-            if (_isFirstPixel)
-            {
-                _isFirstPixel = false;
-                _minVal[0] = r[dataIdx];
-                _minVal[1] = g[dataIdx];
-                _minVal[2] = b[dataIdx];
-                _maxVal[0] = r[dataIdx];
-                _maxVal[1] = g[dataIdx];
-                _maxVal[2] = b[dataIdx];
-            }
-            else
+        const PixelT* rgb[3] = {r, g, b};
+
+        for (int chan = 0; chan < 3; chan++)
+        {
+            _pixelCount[chan] += PixKernels::minMaxSum(rgb[chan], _width, _stride, &_minVal[chan], &_maxVal[chan], &_accumulator[chan]);
+
+            uint32_t* histogram = &_histogram[PixUtils::getHistogramPoints<PixelT>() * chan];
+            const PixelT* k = rgb[chan];
+            for (int i = 0, dataIdx = 0; i < _width; i++, dataIdx += _stride)
             {
-                if (r[dataIdx] < _minVal[0])
-                {
-                    _minVal[0] = r[dataIdx];
-                }
-                if (g[dataIdx] < _minVal[1])
-                {
-                    _minVal[1] = g[dataIdx];
-                }
-                if (b[dataIdx] < _minVal[2])
+                if (PixUtils::isFinite(k[dataIdx]))
                 {
-                    _minVal[2] = b[dataIdx];
-                }
-                if (r[dataIdx] > _maxVal[0])
-                {
-                    _maxVal[0] = r[dataIdx];
-                }
-                if (g[dataIdx] > _maxVal[1])
-                {
-                    _maxVal[1] = g[dataIdx];
-                }
-                if (b[dataIdx] > _maxVal[2])
-                {
-                    _maxVal[2] = b[dataIdx];
+                    histogram[PixUtils::convertRangeToHist(k[dataIdx])]++;
                 }
+            }
+        }
+    }
 
-                _accumulator[0] += r[dataIdx];
-                _accumulator[1] += g[dataIdx];
-                _accumulator[2] += b[dataIdx];
+    template <typename PixelT>
+    PixelVisitor* StatisticsVisitor<PixelT>::clone() const
+    {
+        return new StatisticsVisitor<PixelT>();
+    }
 
-                _histogram[PixUtils::convertRangeToHist(r[dataIdx])]++;
-                _histogram[PixUtils::g_histogramPoints + PixUtils::convertRangeToHist(g[dataIdx])]++;
-                _histogram[PixUtils::g_histogramPoints * 2 + PixUtils::convertRangeToHist(b[dataIdx])]++;
+    template <typename PixelT>
+    void StatisticsVisitor<PixelT>::merge(const PixelVisitor* part)
+    {
+        const StatisticsVisitor<PixelT>* other = static_cast<const StatisticsVisitor<PixelT>*>(part);
+
+        const int chanCount = _isColor ? 3 : 1;
+        for (int chan = 0; chan < chanCount; chan++)
+        {
+            if (other->_minVal[chan] < _minVal[chan])
+            {
+                _minVal[chan] = other->_minVal[chan];
             }
+            if (other->_maxVal[chan] > _maxVal[chan])
+            {
+                _maxVal[chan] = other->_maxVal[chan];
+            }
+            _accumulator[chan] += other->_accumulator[chan];
+            _pixelCount[chan] += other->_pixelCount[chan];
+        }
+
+        const int totalHistogramPoints = PixUtils::getHistogramPoints<PixelT>() * chanCount;
+        for (int i = 0; i < totalHistogramPoints; i++)
+        {
+            _histogram[i] += other->_histogram[i];
         }
     }
 
     template <typename PixelT>
     void StatisticsVisitor<PixelT>::done()
     {
-        const int gOffset = PixUtils::g_histogramPoints;
-        const int bOffset = PixUtils::g_histogramPoints * 2;
+        const int histogramPoints = PixUtils::getHistogramPoints<PixelT>();
+        const int gOffset = histogramPoints;
+        const int bOffset = histogramPoints * 2;
 
-        _statistics.setMinVal(0, _minVal[0]);
-        _statistics.setMaxVal(0, _maxVal[0]);
-        _statistics.setMeanVal(0, (PixelT)(_accumulator[0] / _pixelCount));
-        if (_isColor)
+        const int chanCount = _isColor ? 3 : 1;
+        int64_t halfway[3] = {0, 0, 0};
+        for (int chan = 0; chan < chanCount; chan++)
         {
-            _statistics.setMinVal(1, _minVal[1]);
-            _statistics.setMinVal(2, _minVal[2]);
-            _statistics.setMaxVal(1, _maxVal[1]);
-            _statistics.setMaxVal(2, _maxVal[2]);
-            _statistics.setMeanVal(1, (PixelT)(_accumulator[1] / _pixelCount));
-            _statistics.setMeanVal(2, (PixelT)(_accumulator[2] / _pixelCount));
+            // A channel of nothing but blanks keeps its zeroes
+            if (_pixelCount[chan] == 0)
+            {
+                continue;
+            }
+
+            _statistics.setMinVal(chan, _minVal[chan]);
+            _statistics.setMaxVal(chan, _maxVal[chan]);
+            _statistics.setMeanVal(chan, (PixelT)(_accumulator[chan] / _pixelCount[chan]));
+            halfway[chan] = _pixelCount[chan] / 2;
         }
 
-        int64_t halfway = _pixelCount / 2;
         int64_t pointCount[3] = {0, 0, 0};
-        uint16_t medHist[3] = {0, 0, 0};
+        uint32_t medHist[3] = {0, 0, 0};
         bool done = false;
-        for (int i = 0; (!done) && (i < PixUtils::g_histogramPoints); i++)
+        for (int i = 0; (!done) && (i < histogramPoints); i++)
         {
             done = true;
 
-            if (pointCount[0] < halfway)
+            if (pointCount[0] < halfway[0])
             {
                 pointCount[0] += _histogram[i];
-                if (pointCount[0] >= halfway)
+                if (pointCount[0] >= halfway[0])
                 {
                     PixelT val = 0;
                     PixUtils::convertRangeFromHist(i, &val);
@@ -261,10 +267,10 @@ namespace ELS
 
             if (_isColor)
             {
-                if (pointCount[1] < halfway)
+                if (pointCount[1] < halfway[1])
                 {
                     pointCount[1] += _histogram[gOffset + i];
-                    if (pointCount[1] >= halfway)
+                    if (pointCount[1] >= halfway[1])
                     {
                         PixelT val = 0;
                         PixUtils::convertRangeFromHist(i, &val);
@@ -277,10 +283,10 @@ namespace ELS
                     }
                 }
 
-                if (pointCount[2] < halfway)
+                if (pointCount[2] < halfway[2])
                 {
                     pointCount[2] += _histogram[bOffset + i];
-                    if (pointCount[2] >= halfway)
+                    if (pointCount[2] >= halfway[2])
                     {
                         PixelT val = 0;
                         PixUtils::convertRangeFromHist(i, &val);
@@ -295,15 +301,15 @@ namespace ELS
             }
         }
 
-        int totalHistogramPoints = _isColor ? PixUtils::g_histogramPoints * 3 : PixUtils::g_histogramPoints;
+        int totalHistogramPoints = _isColor ? histogramPoints * 3 : histogramPoints;
         uint32_t* tmp = new uint32_t[totalHistogramPoints];
         for (int i = 0; i < totalHistogramPoints; i++)
         {
             tmp[i] = 0;
         }
-        for (int i = 0; i < PixUtils::g_histogramPoints; i++)
+        for (int i = 0; i < histogramPoints; i++)
         {
-            uint16_t val = i > medHist[0] ? i - medHist[0] : medHist[0] - i;
+            uint32_t val = i > medHist[0] ? i - medHist[0] : medHist[0] - i;
             tmp[val] += _histogram[i];
 
             if (_isColor)
@@ -320,14 +326,14 @@ namespace ELS
         pointCount[1] = 0;
         pointCount[2] = 0;
         done = false;
-        for (int i = 0; (!done) && (i < PixUtils::g_histogramPoints); i++)
+        for (int i = 0; (!done) && (i < histogramPoints); i++)
         {
             done = true;
 
-            if (pointCount[0] < halfway)
+            if (pointCount[0] < halfway[0])
             {
                 pointCount[0] += tmp[i];
-                if (pointCount[0] >= halfway)
+                if (pointCount[0] >= halfway[0])
                 {
                     PixelT val = 0;
                     PixUtils::convertRangeFromHist(i, &val);
@@ -341,10 +347,10 @@ namespace ELS
 
             if (_isColor)
             {
-                if (pointCount[1] < halfway)
+                if (pointCount[1] < halfway[1])
                 {
                     pointCount[1] += tmp[gOffset + i];
-                    if (pointCount[1] >= halfway)
+                    if (pointCount[1] >= halfway[1])
                     {
                         PixelT val = 0;
                         PixUtils::convertRangeFromHist(i, &val);
@@ -356,10 +362,10 @@ namespace ELS
                     }
                 }
 
-                if (pointCount[2] < halfway)
+                if (pointCount[2] < halfway[2])
                 {
                     pointCount[2] += tmp[bOffset + i];
-                    if (pointCount[2] >= halfway)
+                    if (pointCount[2] >= halfway[2])
                     {
                         PixelT val = 0;
                         PixUtils::convertRangeFromHist(i, &val);
@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "imageloadexception.h"
 #include "image.h"
+#include "parallelfor.h"
 #include "fitsimage.h"
 #include "xisfimage.h"
 
@@ -20,6 +24,7 @@ namespace ELS
         {".fits", 5, FT_FITS},
         {".fit", 4, FT_FITS},
         {".fts", 4, FT_FITS},
+        {".fz", 3, FT_FITS},
         {".xisf", 5, FT_XISF},
         {0, 0, FT_UNKNOWN},
     };
@@ -29,6 +34,10 @@ namespace ELS
 
     const int Image::g_maxMagicLen = 6;
 
+    const int Image::g_defaultBandRows = 64;
+
+    const int Image::g_parallelChunkRows = 64;
+
     /* static */
     Image* Image::load(const char* filename)
     {
@@ -54,6 +63,92 @@ namespace ELS
         }
     }
 
+    /* static */
+    Image::Info Image::readInfo(const char* filename,
+                                FileType fileType)
+    {
+        switch (fileType)
+        {
+        case FT_FITS:
+            return FITSImage::readInfo(filename);
+        case FT_XISF:
+            return XISFImage::readInfo(filename);
+        case FT_UNKNOWN:
+        default:
+            throw new ImageLoadException("Could not determine image type from filename extension");
+        }
+    }
+
+    /* static */
+    Image::FileType Image::probe(const char* filename,
+                                 Info* info,
+                                 char* error /* = 0 */)
+    {
+        FileType fileType = fileTypeFromFilename(filename);
+        if (fileType == FT_UNKNOWN)
+        {
+            if (error != 0)
+            {
+                sprintf(error, "%s: unknown file type", filename);
+            }
+            return FT_UNKNOWN;
+        }
+
+        // The format readers reject files that aren't what the
+        // extension says, so there is no separate magic check
+        try
+        {
+            *info = readInfo(filename, fileType);
+        }
+        catch (ImageLoadException* e)
+        {
+            if (error != 0)
+            {
+                sprintf(error, "%s: %s", filename, e->getErrText());
+            }
+            delete e;
+            return FT_UNKNOWN;
+        }
+        catch (...)
+        {
+            if (error != 0)
+            {
+                sprintf(error, "%s: could not read %s header",
+                        filename, g_fileTypeStr[fileType]);
+            }
+            return FT_UNKNOWN;
+        }
+
+        return fileType;
+    }
+
+    /* static */
+    void Image::streamPixels(const char* filename,
+                             FileType fileType,
+                             const std::vector<PixelVisitor*>& visitors,
+                             int bandRows /* = g_defaultBandRows */)
+    {
+        switch (fileType)
+        {
+        case FT_FITS:
+            FITSImage::streamPixels(filename, visitors, bandRows);
+            break;
+        case FT_XISF:
+        {
+            std::unique_ptr<Image> image(XISFImage::load(filename));
+            std::vector<PixelVisitor*>::const_iterator i;
+            for (i = visitors.begin(); i != visitors.end(); ++i)
+            {
+                image->visitPixels(*i);
+            }
+        }
+        break;
+        case FT_UNKNOWN:
+        default:
+            throw new ImageLoadException("Could not determine image type from filename extension");
+        }
+    }
+
     /* static */
     Image::FileType Image::isSupportedFile(const char* filename,
                                            char* error /* = 0 */)
@@ -165,6 +260,132 @@ namespace ELS
 
     Image::~Image() {}
 
+    void Image::visitPixels(PixelVisitor* visitor) const
+    {
+        startVisit(visitor);
+        visitRows(visitor, 0, getHeight(), 1);
+        visitor->done();
+    }
+
+    void Image::visitPixels(PixelVisitor* visitor,
+                            int firstRow,
+                            int lastRow,
+                            int rowStep /* = 1 */) const
+    {
+        startVisit(visitor);
+        visitRows(visitor, std::max(firstRow, 0), std::min(lastRow, getHeight()), rowStep);
+        visitor->done();
+    }
+
+    void Image::visitPixelsParallel(PixelVisitor* visitor) const
+    {
+        const int height = getHeight();
+        const int chunkCount = (height + g_parallelChunkRows - 1) / g_parallelChunkRows;
+        const int slotCount = ParallelFor::slotCount(chunkCount);
+
+        PixelVisitor* firstPart = (slotCount < 2) ? 0 : visitor->clone();
+        if (firstPart == 0)
+        {
+            visitPixels(visitor);
+            return;
+        }
+
+        // The original takes the caller's share of the rows, alongside
+        // one clone per other slot
+        std::vector<std::unique_ptr<PixelVisitor>> parts;
+        parts.push_back(std::unique_ptr<PixelVisitor>(firstPart));
+        for (int i = 2; i < slotCount; i++)
+        {
+            parts.push_back(std::unique_ptr<PixelVisitor>(visitor->clone()));
+        }
+
+        std::vector<PixelVisitor*> slotVisitors;
+        slotVisitors.push_back(visitor);
+        startVisit(visitor);
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            slotVisitors.push_back(parts[i].get());
+            startVisit(parts[i].get());
+        }
+
+        ParallelFor::run(chunkCount, [&](int slot, int64_t chunk)
+                         {
+                             int firstRow = (int)chunk * g_parallelChunkRows;
+                             visitRows(slotVisitors[slot], firstRow, std::min(firstRow + g_parallelChunkRows, height), 1);
+                             return true;
+                         });
+
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            visitor->merge(parts[i].get());
+        }
+        visitor->done();
+    }
+
+    void Image::startVisit(PixelVisitor* visitor) const
+    {
+        if (!isColor())
+        {
+            visitor->pixelFormat(PF_GRAY);
+            visitor->dimensions(getWidth(), getHeight());
+            visitor->rowInfo(1);
+        }
+        else
+        {
+            visitor->pixelFormat(PF_RGB);
+            visitor->dimensions(getWidth(), getHeight());
+            visitor->rowInfo(getRasterFormat() == RF_INTERLEAVED ? 3 : 1);
+        }
+    }
+
+    int Image::getBytesPerSample() const
+    {
+        return getBytesPerSample(getSampleFormat());
+    }
+
+    /* static */
+    int Image::getBytesPerSample(SampleFormat sampleFormat)
+    {
+        switch (sampleFormat)
+        {
+        case SF_INT_8:
+        case SF_UINT_8:
+            return 1;
+        case SF_INT_16:
+        case SF_UINT_16:
+            return 2;
+        case SF_INT_32:
+        case SF_UINT_32:
+        case SF_FLOAT:
+            return 4;
+        case SF_DOUBLE:
+            return 8;
+        }
+
+        return 0;
+    }
+
+    const uint8_t* Image::getGrayBytes() const
+    {
+        return 0;
+    }
+
+    /* virtual */
+    void Image::detachFromFile()
+    {
+    }
+
+    int64_t Image::getPixelDataSize() const
+    {
+        int64_t size = (int64_t)getWidth() * getHeight() * getBytesPerSample();
+        if (isColor())
+        {
+            size *= 3;
+        }
+
+        return size;
+    }
+
     const char* Image::getImageType() const
     {
         SampleFormat sf = getSampleFormat();
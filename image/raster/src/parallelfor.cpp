@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallelfor.h"
+
+namespace ELS
+{
+
+    namespace
+    {
+
+        struct Job
+        {
+            int64_t count;
+            const std::function<bool(int, int64_t)>* work;
+            std::atomic<int64_t> next;
+            std::atomic<bool> stopped;
+
+            // Guarded by the pool's mutex
+            int nextSlot;
+            int running;
+            std::exception_ptr error;
+            std::condition_variable finished;
+        };
+
+        class Pool
+        {
+        public:
+            Pool();
+
+            int getWorkerCount() const;
+
+            // Queue requests for helpers on a job, then take them back
+            // if no worker has picked them up by the time the caller
+            // is done, and wait out the ones that did
+            void requestHelpers(Job* job, int helperCount);
+            void finish(Job* job);
+
+            void drain(Job* job, int slot);
+
+        private:
+            void workerLoop();
+
+        private:
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            // One entry per helper wanted
+            std::deque<Job*> _requests;
+            std::vector<std::thread> _workers;
+        };
+
+        Pool::Pool()
+            : _mutex(),
+              _wake(),
+              _requests(),
+              _workers()
+        {
+            int workerCount = (int)std::thread::hardware_concurrency() - 1;
+            for (int i = 0; i < workerCount; i++)
+            {
+                _workers.push_back(std::thread(&Pool::workerLoop, this));
+                // Lives as long as the process
+                _workers.back().detach();
+            }
+        }
+
+        int Pool::getWorkerCount() const
+        {
+            return (int)_workers.size();
+        }
+
+        void Pool::requestHelpers(Job* job, int helperCount)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (int i = 0; i < helperCount; i++)
+                {
+                    _requests.push_back(job);
+                }
+            }
+            for (int i = 0; i < helperCount; i++)
+            {
+                _wake.notify_one();
+            }
+        }
+
+        void Pool::finish(Job* job)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _requests.erase(std::remove(_requests.begin(), _requests.end(), job), _requests.end());
+            job->finished.wait(lock, [job]()
+                               { return job->running == 0; });
+        }
+
+        void Pool::drain(Job* job, int slot)
+        {
+            for (int64_t i = job->next++; (i < job->count) && !job->stopped; i = job->next++)
+            {
+                try
+                {
+                    if (!(*job->work)(slot, i))
+                    {
+                        job->stopped = true;
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!job->error)
+                    {
+                        job->error = std::current_exception();
+                    }
+                    job->stopped = true;
+                }
+            }
+        }
+
+        void Pool::workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (;;)
+            {
+                _wake.wait(lock, [this]()
+                           { return !_requests.empty(); });
+
+                Job* job = _requests.front();
+                _requests.pop_front();
+                int slot = job->nextSlot++;
+                job->running++;
+
+                lock.unlock();
+                drain(job, slot);
+                lock.lock();
+
+                if (--job->running == 0)
+                {
+                    job->finished.notify_all();
+                }
+            }
+        }
+
+        Pool& getPool()
+        {
+            // Never destroyed; workers may still be parked on it at exit
+            static Pool* pool = new Pool();
+            return *pool;
+        }
+
+    }
+
+    /* static */
+    int ParallelFor::slotCount(int64_t count)
+    {
+        return (int)std::max((int64_t)1, std::min(count, (int64_t)getPool().getWorkerCount() + 1));
+    }
+
+    /* static */
+    bool ParallelFor::run(int64_t count,
+                          const std::function<bool(int, int64_t)>& work)
+    {
+        if (count <= 0)
+        {
+            return true;
+        }
+
+        Job job;
+        job.count = count;
+        job.work = &work;
+        job.next = 0;
+        job.stopped = false;
+        job.nextSlot = 1;
+        job.running = 0;
+
+        Pool& pool = getPool();
+        pool.requestHelpers(&job, slotCount(count) - 1);
+        pool.drain(&job, 0);
+        pool.finish(&job);
+
+        if (job.error)
+        {
+            std::rethrow_exception(job.error);
+        }
+
+        return !job.stopped;
+    }
+
+}
@@ -4,6 +4,11 @@
 namespace ELS
 {
 
+    /* virtual */
+    PixelVisitor::~PixelVisitor()
+    {
+    }
+
     void PixelVisitor::rowGray(int y,
                                const int8_t* k)
     {
@@ -180,4 +185,16 @@ namespace ELS
         throw new PixelVisitorTypeMismatch("This PixelVisitor doesn't handle 64-bit floating point samples");
     }
 
+    /* virtual */
+    PixelVisitor* PixelVisitor::clone() const
+    {
+        return 0;
+    }
+
+    /* virtual */
+    void PixelVisitor::merge(const PixelVisitor* part)
+    {
+        (void)part;
+    }
+
 }
@@ -0,0 +1,783 @@
+// The auto-vectoriser needs more than -O2 gives it before GCC 12, and
+// its cost model is too timid at -O2 after; this file is only kernels
+#pragma GCC optimize("O3")
+
+#include <string.h>
+
+#include "pixkernels.h"
+#include "pixutils.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PIX_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define PIX_KERNEL
+#endif
+
+namespace ELS
+{
+
+    // Integer samples sum exactly in 64 bits, which leaves the
+    // compiler free to vectorise. Strides of 1 and 3 (planar and
+    // interleaved rows) get their own loops so the stride is a
+    // constant the vectoriser can see.
+    template <typename PixelT, int Stride>
+    static inline __attribute__((always_inline)) int intMinMaxSum(const PixelT* __restrict k,
+                                                                   int count,
+                                                                   int stride,
+                                                                   PixelT* minVal,
+                                                                   PixelT* maxVal,
+                                                                   double* sum)
+    {
+        const int step = (Stride == 0) ? stride : Stride;
+        PixelT lo = *minVal;
+        PixelT hi = *maxVal;
+        int64_t acc = 0;
+        for (int i = 0; i < count; i++)
+        {
+            PixelT v = k[(int64_t)i * step];
+            lo = (v < lo) ? v : lo;
+            hi = (v > hi) ? v : hi;
+            acc += v;
+        }
+
+        *minVal = lo;
+        *maxVal = hi;
+        *sum += (double)acc;
+
+        return count;
+    }
+
+    template <typename PixelT>
+    static inline __attribute__((always_inline)) int intMinMaxSum(const PixelT* k,
+                                                                   int count,
+                                                                   int stride,
+                                                                   PixelT* minVal,
+                                                                   PixelT* maxVal,
+                                                                   double* sum)
+    {
+        switch (stride)
+        {
+        case 1:
+            return intMinMaxSum<PixelT, 1>(k, count, stride, minVal, maxVal, sum);
+        case 3:
+            return intMinMaxSum<PixelT, 3>(k, count, stride, minVal, maxVal, sum);
+        default:
+            return intMinMaxSum<PixelT, 0>(k, count, stride, minVal, maxVal, sum);
+        }
+    }
+
+    // Floating point sums can't be reordered behind our back, so the
+    // lanes are spelled out with vector types; each lane accumulates
+    // in double as the scalar code did. NaN and infinite samples (FITS
+    // blanks) are left out, found as those whose v - v isn't zero.
+    typedef float V8F __attribute__((vector_size(32)));
+    typedef double V8D __attribute__((vector_size(64)));
+    typedef double V4D __attribute__((vector_size(32)));
+
+    template <typename PixelT, typename VecT, typename AccVecT>
+    static inline __attribute__((always_inline)) int fpMinMaxSum(const PixelT* k,
+                                                                 int count,
+                                                                 int stride,
+                                                                 PixelT* minVal,
+                                                                 PixelT* maxVal,
+                                                                 double* sum)
+    {
+        const int lanes = sizeof(VecT) / sizeof(PixelT);
+
+        VecT lo;
+        VecT hi;
+        VecT zero = {};
+        AccVecT acc = {};
+        for (int j = 0; j < lanes; j++)
+        {
+            lo[j] = *minVal;
+            hi[j] = *maxVal;
+        }
+
+        // Lanes of the finite mask are all ones, i.e. -1, so taking
+        // them away counts the samples kept
+        typedef decltype(zero == zero) MaskT;
+        MaskT kept = {};
+
+        auto fold = [&](const VecT& in) __attribute__((always_inline))
+        {
+            MaskT finite = (in - in) == zero;
+            VecT v = finite ? in : zero;
+            lo = (finite & (v < lo)) ? v : lo;
+            hi = (finite & (v > hi)) ? v : hi;
+            acc += __builtin_convertvector(v, AccVecT);
+            kept -= finite;
+        };
+
+        int i = 0;
+        if (stride == 1)
+        {
+            for (; i + lanes <= count; i += lanes)
+            {
+                VecT v;
+                memcpy(&v, k + i, sizeof(v));
+                fold(v);
+            }
+        }
+        else
+        {
+            for (; i + lanes <= count; i += lanes)
+            {
+                VecT v;
+                for (int j = 0; j < lanes; j++)
+                {
+                    v[j] = k[(int64_t)(i + j) * stride];
+                }
+                fold(v);
+            }
+        }
+
+        double total = 0.0;
+        int keptCount = 0;
+        for (int j = 0; j < lanes; j++)
+        {
+            if (lo[j] < *minVal)
+            {
+                *minVal = lo[j];
+            }
+            if (hi[j] > *maxVal)
+            {
+                *maxVal = hi[j];
+            }
+            total += acc[j];
+            keptCount += (int)kept[j];
+        }
+
+        for (; i < count; i++)
+        {
+            PixelT v = k[(int64_t)i * stride];
+            if ((v - v) != 0)
+            {
+                continue;
+            }
+            if (v < *minVal)
+            {
+                *minVal = v;
+            }
+            if (v > *maxVal)
+            {
+                *maxVal = v;
+            }
+            total += v;
+            keptCount++;
+        }
+
+        *sum += total;
+
+        return keptCount;
+    }
+
+    PIX_KERNEL
+    static int minMaxSumI8(const int8_t* k, int count, int stride,
+                           int8_t* minVal, int8_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumI16(const int16_t* k, int count, int stride,
+                            int16_t* minVal, int16_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumI32(const int32_t* k, int count, int stride,
+                            int32_t* minVal, int32_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumU8(const uint8_t* k, int count, int stride,
+                           uint8_t* minVal, uint8_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumU16(const uint16_t* k, int count, int stride,
+                            uint16_t* minVal, uint16_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumU32(const uint32_t* k, int count, int stride,
+                            uint32_t* minVal, uint32_t* maxVal, double* sum)
+    {
+        return intMinMaxSum(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumF(const float* k, int count, int stride,
+                          float* minVal, float* maxVal, double* sum)
+    {
+        return fpMinMaxSum<float, V8F, V8D>(k, count, stride, minVal, maxVal, sum);
+    }
+
+    PIX_KERNEL
+    static int minMaxSumD(const double* k, int count, int stride,
+                          double* minVal, double* maxVal, double* sum)
+    {
+        return fpMinMaxSum<double, V4D, V4D>(k, count, stride, minVal, maxVal, sum);
+    }
+
+    // Histogram bin of a sample, the index into the display LUTs. This
+    // must give the same answer as PixUtils::convertRangeToHist; it is
+    // repeated here so that it inlines. Integers only shift, and
+    // floating point clamps before converting through int32, all of
+    // which vectorises.
+    static const int g_wideShift = 32 - PixUtils::g_wideHistogramBits;
+    static const float g_wideRangeMaxF = (float)((1 << PixUtils::g_wideHistogramBits) - 1);
+    static const double g_wideRangeMaxD = (double)((1 << PixUtils::g_wideHistogramBits) - 1);
+
+    static inline __attribute__((always_inline)) uint32_t histBin(int8_t v)
+    {
+        return (uint8_t)(v ^ 0x80);
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(int16_t v)
+    {
+        return (uint16_t)(v ^ 0x8000);
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(int32_t v)
+    {
+        return ((uint32_t)v ^ 0x80000000u) >> g_wideShift;
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(uint8_t v)
+    {
+        return v;
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(uint16_t v)
+    {
+        return v;
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(uint32_t v)
+    {
+        return v >> g_wideShift;
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(float v)
+    {
+        float scaled = v * g_wideRangeMaxF;
+        scaled = scaled > 0.0f ? scaled : 0.0f;
+        scaled = scaled < g_wideRangeMaxF ? scaled : g_wideRangeMaxF;
+        return (uint32_t)(int32_t)scaled;
+    }
+
+    static inline __attribute__((always_inline)) uint32_t histBin(double v)
+    {
+        double scaled = v * g_wideRangeMaxD;
+        scaled = scaled > 0.0 ? scaled : 0.0;
+        scaled = scaled < g_wideRangeMaxD ? scaled : g_wideRangeMaxD;
+        return (uint32_t)(int32_t)scaled;
+    }
+
+    // Opaque ARGB32, as QImage::Format_RGB32 wants it
+    static inline __attribute__((always_inline)) uint32_t packArgb(uint32_t red, uint32_t green, uint32_t blue)
+    {
+        return 0xff000000u | (red << 16) | (green << 8) | blue;
+    }
+
+    // Grey rows are one byte LUT lookup per sample, written straight
+    // to a Grayscale8 row
+    template <typename PixelT, int Stride>
+    static inline __attribute__((always_inline)) void renderGrayRow(const PixelT* __restrict k,
+                                                                    int count,
+                                                                    int stride,
+                                                                    const uint8_t* __restrict lut,
+                                                                    uint8_t* __restrict out)
+    {
+        const int step = (Stride == 0) ? stride : Stride;
+        for (int i = 0; i < count; i++)
+        {
+            out[i] = lut[histBin(k[(int64_t)i * step])];
+        }
+    }
+
+    template <typename PixelT>
+    static inline __attribute__((always_inline)) void renderGrayRow(const PixelT* k,
+                                                                    int count,
+                                                                    int stride,
+                                                                    const uint8_t* lut,
+                                                                    uint8_t* out)
+    {
+        switch (stride)
+        {
+        case 1:
+            renderGrayRow<PixelT, 1>(k, count, stride, lut, out);
+            break;
+        case 3:
+            renderGrayRow<PixelT, 3>(k, count, stride, lut, out);
+            break;
+        default:
+            renderGrayRow<PixelT, 0>(k, count, stride, lut, out);
+            break;
+        }
+    }
+
+    // Colour rows combine three byte LUTs, and byte gathers don't
+    // vectorise, so they go in blocks: the bins and the ARGB packing
+    // either side of the lookups each get a loop of their own that
+    // does
+    static const int g_renderBlock = 256;
+
+    template <typename PixelT, int Stride>
+    static inline __attribute__((always_inline)) void renderRgbRow(const PixelT* __restrict r,
+                                                                   const PixelT* __restrict g,
+                                                                   const PixelT* __restrict b,
+                                                                   int count,
+                                                                   int stride,
+                                                                   const uint8_t* __restrict rLut,
+                                                                   const uint8_t* __restrict gLut,
+                                                                   const uint8_t* __restrict bLut,
+                                                                   uint32_t* __restrict out)
+    {
+        const int step = (Stride == 0) ? stride : Stride;
+        const PixelT* planes[3] = {r, g, b};
+        const uint8_t* luts[3] = {rLut, gLut, bLut};
+
+        uint32_t bins[g_renderBlock];
+        uint8_t vals[3][g_renderBlock];
+        for (int i = 0; i < count; i += g_renderBlock)
+        {
+            const int blockCount = (count - i < g_renderBlock) ? count - i : g_renderBlock;
+            for (int chan = 0; chan < 3; chan++)
+            {
+                const PixelT* __restrict k = planes[chan] + (int64_t)i * step;
+                for (int j = 0; j < blockCount; j++)
+                {
+                    bins[j] = histBin(k[(int64_t)j * step]);
+                }
+
+                const uint8_t* __restrict lut = luts[chan];
+                uint8_t* __restrict val = vals[chan];
+                for (int j = 0; j < blockCount; j++)
+                {
+                    val[j] = lut[bins[j]];
+                }
+            }
+
+            uint32_t* __restrict blockOut = out + i;
+            for (int j = 0; j < blockCount; j++)
+            {
+                blockOut[j] = packArgb(vals[0][j], vals[1][j], vals[2][j]);
+            }
+        }
+    }
+
+    template <typename PixelT>
+    static inline __attribute__((always_inline)) void renderRgbRow(const PixelT* r,
+                                                                   const PixelT* g,
+                                                                   const PixelT* b,
+                                                                   int count,
+                                                                   int stride,
+                                                                   const uint8_t* rLut,
+                                                                   const uint8_t* gLut,
+                                                                   const uint8_t* bLut,
+                                                                   uint32_t* out)
+    {
+        switch (stride)
+        {
+        case 1:
+            renderRgbRow<PixelT, 1>(r, g, b, count, stride, rLut, gLut, bLut, out);
+            break;
+        case 3:
+            renderRgbRow<PixelT, 3>(r, g, b, count, stride, rLut, gLut, bLut, out);
+            break;
+        default:
+            renderRgbRow<PixelT, 0>(r, g, b, count, stride, rLut, gLut, bLut, out);
+            break;
+        }
+    }
+
+    PIX_KERNEL
+    static void renderGrayI8(const int8_t* k, int count, int stride,
+                             const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayI16(const int16_t* k, int count, int stride,
+                              const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayI32(const int32_t* k, int count, int stride,
+                              const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayU8(const uint8_t* k, int count, int stride,
+                             const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayU16(const uint16_t* k, int count, int stride,
+                              const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayU32(const uint32_t* k, int count, int stride,
+                              const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayF(const float* k, int count, int stride,
+                            const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderGrayD(const double* k, int count, int stride,
+                            const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayRow(k, count, stride, lut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbI8(const int8_t* r, const int8_t* g, const int8_t* b,
+                            int count, int stride, const uint8_t* rLut,
+                            const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbI16(const int16_t* r, const int16_t* g, const int16_t* b,
+                             int count, int stride, const uint8_t* rLut,
+                             const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbI32(const int32_t* r, const int32_t* g, const int32_t* b,
+                             int count, int stride, const uint8_t* rLut,
+                             const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbU8(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                            int count, int stride, const uint8_t* rLut,
+                            const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbU16(const uint16_t* r, const uint16_t* g, const uint16_t* b,
+                             int count, int stride, const uint8_t* rLut,
+                             const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbU32(const uint32_t* r, const uint32_t* g, const uint32_t* b,
+                             int count, int stride, const uint8_t* rLut,
+                             const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbF(const float* r, const float* g, const float* b,
+                           int count, int stride, const uint8_t* rLut,
+                           const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    PIX_KERNEL
+    static void renderRgbD(const double* r, const double* g, const double* b,
+                           int count, int stride, const uint8_t* rLut,
+                           const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbRow(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    // The four channels are summed two at a time in 16-bit halves of
+    // a 32-bit word, which can't overflow (4 * 255 < 65536) and keeps
+    // the loop in plain integer ops the vectoriser handles
+    PIX_KERNEL
+    static void halveArgbImpl(const uint32_t* __restrict row0, const uint32_t* __restrict row1,
+                              int count, uint32_t* __restrict out)
+    {
+        const uint32_t mask = 0x00ff00ffu;
+        const uint32_t round = 0x00020002u;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t a = row0[2 * i];
+            uint32_t b = row0[2 * i + 1];
+            uint32_t c = row1[2 * i];
+            uint32_t d = row1[2 * i + 1];
+            uint32_t lo = (a & mask) + (b & mask) + (c & mask) + (d & mask) + round;
+            uint32_t hi = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + round;
+            out[i] = ((lo >> 2) & mask) | (((hi >> 2) & mask) << 8);
+        }
+    }
+
+    PIX_KERNEL
+    static void halveGrayImpl(const uint8_t* __restrict row0, const uint8_t* __restrict row1,
+                              int count, uint8_t* __restrict out)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t sum = (uint32_t)row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1];
+            out[i] = (uint8_t)((sum + 2) >> 2);
+        }
+    }
+
+    // The clipping, midtones and expansion functions of PixUtils, with
+    // their special cases as selects so the loop vectorises
+    PIX_KERNEL
+    static void stretchLutImpl(int first, int count, double binScale,
+                               double sClip, double hClip, double mBal,
+                               double sExp, double hExp, uint8_t* __restrict out)
+    {
+        const double clipScale = 1.0 / (hClip - sClip);
+        const double expScale = 1.0 / (hExp - sExp);
+        for (int i = 0; i < count; i++)
+        {
+            double pixel = (first + i) * binScale;
+
+            double clipped = (pixel - sClip) * clipScale;
+            clipped = pixel < sClip ? 0.0 : clipped;
+            clipped = pixel > hClip ? 1.0 : clipped;
+
+            double mtf = ((mBal - 1) * clipped) / (((2 * mBal - 1) * clipped) - mBal);
+            mtf = clipped == mBal ? 0.5 : mtf;
+            mtf = clipped == 0.0 ? 0.0 : mtf;
+            mtf = clipped == 1.0 ? 1.0 : mtf;
+
+            double val = (mtf - sExp) * expScale * 255.0;
+            val = val > 0.0 ? val : 0.0;
+            val = val < 255.0 ? val : 255.0;
+            out[i] = (uint8_t)(int32_t)val;
+        }
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const int8_t* k, int count, int stride,
+                              int8_t* minVal, int8_t* maxVal, double* sum)
+    {
+        return minMaxSumI8(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const int16_t* k, int count, int stride,
+                              int16_t* minVal, int16_t* maxVal, double* sum)
+    {
+        return minMaxSumI16(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const int32_t* k, int count, int stride,
+                              int32_t* minVal, int32_t* maxVal, double* sum)
+    {
+        return minMaxSumI32(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const uint8_t* k, int count, int stride,
+                              uint8_t* minVal, uint8_t* maxVal, double* sum)
+    {
+        return minMaxSumU8(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const uint16_t* k, int count, int stride,
+                              uint16_t* minVal, uint16_t* maxVal, double* sum)
+    {
+        return minMaxSumU16(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const uint32_t* k, int count, int stride,
+                              uint32_t* minVal, uint32_t* maxVal, double* sum)
+    {
+        return minMaxSumU32(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const float* k, int count, int stride,
+                              float* minVal, float* maxVal, double* sum)
+    {
+        return minMaxSumF(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    int PixKernels::minMaxSum(const double* k, int count, int stride,
+                              double* minVal, double* maxVal, double* sum)
+    {
+        return minMaxSumD(k, count, stride, minVal, maxVal, sum);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const int8_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayI8(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const int16_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayI16(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const int32_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayI32(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const uint8_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayU8(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const uint16_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayU16(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const uint32_t* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayU32(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const float* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayF(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderGray(const double* k, int count, int stride,
+                                const uint8_t* lut, uint8_t* out)
+    {
+        renderGrayD(k, count, stride, lut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const int8_t* r, const int8_t* g, const int8_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbI8(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const int16_t* r, const int16_t* g, const int16_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbI16(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const int32_t* r, const int32_t* g, const int32_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbI32(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbU8(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const uint16_t* r, const uint16_t* g, const uint16_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbU16(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const uint32_t* r, const uint32_t* g, const uint32_t* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbU32(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const float* r, const float* g, const float* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbF(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::renderRgb(const double* r, const double* g, const double* b,
+                               int count, int stride, const uint8_t* rLut,
+                               const uint8_t* gLut, const uint8_t* bLut, uint32_t* out)
+    {
+        renderRgbD(r, g, b, count, stride, rLut, gLut, bLut, out);
+    }
+
+    /* static */
+    void PixKernels::halveArgb(const uint32_t* row0, const uint32_t* row1,
+                               int count, uint32_t* out)
+    {
+        halveArgbImpl(row0, row1, count, out);
+    }
+
+    /* static */
+    void PixKernels::halveGray(const uint8_t* row0, const uint8_t* row1,
+                               int count, uint8_t* out)
+    {
+        halveGrayImpl(row0, row1, count, out);
+    }
+
+    /* static */
+    void PixKernels::stretchLut(int first, int count, double binScale,
+                                double sClip, double hClip, double mBal,
+                                double sExp, double hExp, uint8_t* out)
+    {
+        stretchLutImpl(first, count, binScale, sClip, hClip, mBal, sExp, hExp, out);
+    }
+
+}
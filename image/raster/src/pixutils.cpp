@@ -3,8 +3,10 @@
 namespace ELS
 {
 
+    const int PixUtils::g_byteHistogramPoints = 256;
     const int PixUtils::g_histogramPoints = 65536;
-    const int PixUtils::g_histogramRangeMax = PixUtils::g_histogramPoints - 1;
+    const int PixUtils::g_wideHistogramPoints = 1 << PixUtils::g_wideHistogramBits;
+    const int PixUtils::g_wideHistogramRangeMax = PixUtils::g_wideHistogramPoints - 1;
 
     const double PixUtils::g_madnConstant = 1.4826;
 
@@ -221,158 +223,115 @@ namespace ELS
         return (pixel - sExp) / (hExp - sExp);
     }
 
+    // Integer samples keep as many of their top bits as they have
+    // bins for, signed ones after flipping the sign bit to move them
+    // into the unsigned range. PixKernels renders with the same
+    // mapping.
+
     /* static */
-    uint16_t PixUtils::convertRangeToHist(int8_t val)
+    uint32_t PixUtils::convertRangeToHist(int8_t val)
     {
-        return convertRangeToHist((uint8_t)val + PixUtils::g_u8Mid + 1);
+        return convertRangeToHist((uint8_t)(val ^ 0x80));
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(int16_t val)
+    uint32_t PixUtils::convertRangeToHist(int16_t val)
     {
-        return convertRangeToHist((uint16_t)val + PixUtils::g_u16Mid + 1);
+        return convertRangeToHist((uint16_t)(val ^ 0x8000));
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(int32_t val)
+    uint32_t PixUtils::convertRangeToHist(int32_t val)
     {
-        return convertRangeToHist((uint32_t)val + PixUtils::g_u32Mid + 1);
+        return convertRangeToHist((uint32_t)val ^ 0x80000000u);
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(uint8_t val)
+    uint32_t PixUtils::convertRangeToHist(uint8_t val)
     {
-        uint8_t factor = g_u8Max / g_histogramRangeMax;
-
-        uint16_t newVal = (uint16_t)(val / factor);
-        if (!(newVal < g_histogramPoints))
-        {
-            // printf("Fixed newVal of %d to %d\n", newVal, g_histogramPoints - 1);
-            // fflush(stdout);
-            newVal = g_histogramPoints - 1;
-        }
-
-        return newVal;
+        return val;
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(uint16_t val)
+    uint32_t PixUtils::convertRangeToHist(uint16_t val)
     {
-        uint16_t factor = g_u16Max / g_histogramRangeMax;
-
-        uint16_t newVal = val / factor;
-        if (!(newVal < g_histogramPoints))
-        {
-            // printf("Fixed newVal of %d to %d\n", newVal, g_histogramPoints - 1);
-            // fflush(stdout);
-            newVal = g_histogramPoints - 1;
-        }
-
-        return newVal;
+        return val;
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(uint32_t val)
+    uint32_t PixUtils::convertRangeToHist(uint32_t val)
     {
-        uint32_t factor = g_u32Max / g_histogramRangeMax;
-
-        uint16_t newVal = (uint16_t)(val / factor);
-        if (!(newVal < g_histogramPoints))
-        {
-            // printf("Fixed newVal of %d to %d\n", newVal, g_histogramPoints - 1);
-            // fflush(stdout);
-            newVal = g_histogramPoints - 1;
-        }
-
-        return newVal;
+        return val >> (32 - g_wideHistogramBits);
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(float val)
+    uint32_t PixUtils::convertRangeToHist(float val)
     {
-        uint16_t newVal = (uint16_t)(val * g_histogramRangeMax);
-        if (!(newVal < g_histogramPoints))
-        {
-            // printf("Fixed newVal of %d to %d\n", newVal, g_histogramPoints - 1);
-            // fflush(stdout);
-            newVal = g_histogramPoints - 1;
-        }
+        // Clamp before converting; out of range (and NaN) samples
+        // would otherwise wrap
+        float scaled = val * g_wideHistogramRangeMax;
+        scaled = scaled > 0.0f ? scaled : 0.0f;
+        scaled = scaled < (float)g_wideHistogramRangeMax ? scaled : (float)g_wideHistogramRangeMax;
 
-        return newVal;
+        return (uint32_t)scaled;
     }
 
     /* static */
-    uint16_t PixUtils::convertRangeToHist(double val)
+    uint32_t PixUtils::convertRangeToHist(double val)
     {
-        uint16_t newVal = (uint16_t)(val * g_histogramRangeMax);
-        if (!(newVal < g_histogramPoints))
-        {
-            // printf("Fixed newVal of %d to %d\n", newVal, g_histogramPoints - 1);
-            // fflush(stdout);
-            newVal = g_histogramPoints - 1;
-        }
+        double scaled = val * g_wideHistogramRangeMax;
+        scaled = scaled > 0.0 ? scaled : 0.0;
+        scaled = scaled < (double)g_wideHistogramRangeMax ? scaled : (double)g_wideHistogramRangeMax;
 
-        return newVal;
+        return (uint32_t)scaled;
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, int8_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, int8_t* val)
     {
-        uint8_t factor = g_u8Max / g_histogramRangeMax;
-
-        *val = (int8_t)(((int32_t)hist / factor) - g_u8Mid - 1);
+        *val = (int8_t)(hist ^ 0x80);
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, int16_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, int16_t* val)
     {
-        uint16_t factor = g_u16Max / g_histogramRangeMax;
-
-        *val = (int16_t)(((int32_t)hist / factor) - g_u16Mid - 1);
+        *val = (int16_t)(hist ^ 0x8000);
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, int32_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, int32_t* val)
     {
-        uint32_t factor = g_u32Max / g_histogramRangeMax;
-
-        *val = (int32_t)(((int64_t)hist / factor) - g_u32Mid - 1);
+        *val = (int32_t)((hist << (32 - g_wideHistogramBits)) ^ 0x80000000u);
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, uint8_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, uint8_t* val)
     {
-        uint8_t factor = g_u8Max / g_histogramRangeMax;
-
-        *val = (uint8_t)(hist / factor);
+        *val = (uint8_t)hist;
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, uint16_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, uint16_t* val)
     {
-        uint16_t factor = g_u16Max / g_histogramRangeMax;
-
-        *val = (uint16_t)(hist / factor);
+        *val = (uint16_t)hist;
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, uint32_t* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, uint32_t* val)
     {
-        uint32_t factor = g_u32Max / g_histogramRangeMax;
-
-        *val = (uint32_t)(hist / factor);
+        *val = hist << (32 - g_wideHistogramBits);
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, float* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, float* val)
     {
-        *val = (float)hist / g_histogramRangeMax;
+        *val = (float)hist / g_wideHistogramRangeMax;
     }
 
     /* static */
-    void PixUtils::convertRangeFromHist(uint16_t hist, double* val)
+    void PixUtils::convertRangeFromHist(uint32_t hist, double* val)
     {
-        *val = (double)hist / g_histogramRangeMax;
+        *val = (double)hist / g_wideHistogramRangeMax;
     }
 
-}
\ No newline at end of file
+}
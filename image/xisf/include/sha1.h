@@ -0,0 +1,33 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string>
+
+namespace ELS
+{
+
+    // SHA-1 (FIPS 180-4), enough to check the checksums XISF data
+    // blocks carry
+    class SHA1
+    {
+    public:
+        SHA1();
+
+        void update(const void* data,
+                    size_t size);
+
+        // 40 lowercase hex digits. Nothing can be added after this.
+        std::string hexDigest();
+
+    private:
+        void processBlock(const uint8_t* block);
+
+    private:
+        uint32_t _state[5];
+        uint64_t _totalBytes;
+        uint8_t _buffer[64];
+        size_t _bufferUsed;
+    };
+
+}
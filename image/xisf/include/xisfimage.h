@@ -12,6 +12,9 @@
 #pragma GCC diagnostic pop
 
 #include <inttypes.h>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "image.h"
 #include "pixelvisitor.h"
@@ -24,6 +27,7 @@ namespace ELS
     {
     public:
         static XISFImage* load(const char* filename);
+        static Image::Info readInfo(const char* filename);
 
     public:
         virtual ~XISFImage() override;
@@ -36,7 +40,48 @@ namespace ELS
         virtual RasterFormat getRasterFormat() const override;
         virtual SampleFormat getSampleFormat() const override;
 
-        virtual void visitPixels(PixelVisitor* visitor) const override;
+        virtual const uint8_t* getGrayBytes() const override;
+
+    protected:
+        virtual void visitRows(PixelVisitor* visitor,
+                               int firstRow,
+                               int lastRow,
+                               int rowStep) const override;
+
+    private:
+        static Image::Info readInfo(pcl::XISFReader& reader,
+                                    const char* filename);
+
+    private:
+        enum Codec
+        {
+            C_NONE,
+            C_ZLIB,
+            C_LZ4
+        };
+
+        // Where and how the image's attached data block is stored,
+        // as described by the XML header
+        struct DataBlock
+        {
+            int64_t position;
+            int64_t size;
+            Codec codec;
+            bool isByteShuffled;
+            int itemSize;
+            int64_t uncompressedSize;
+            std::vector<std::pair<int64_t, int64_t>> subblocks;
+            // SHA-1 of the block as stored, in lowercase hex; empty if
+            // the header gives no checksum
+            std::string sha1;
+        };
+
+        static bool readDataBlockInfo(const char* filename,
+                                      const Image::Info& info,
+                                      int channelCount,
+                                      DataBlock* block);
+        static void* readDataBlock(const char* filename,
+                                   const DataBlock& block);
 
     private:
         XISFImage(SampleFormat sampleFormat,
@@ -64,17 +109,25 @@ namespace ELS
                   int width,
                   int height,
                   pcl::DImage* img);
+        XISFImage(SampleFormat sampleFormat,
+                  bool isColor,
+                  int width,
+                  int height,
+                  void* raw);
+
+        template <typename PixelT>
+        void visitRawRows(const PixelT* pixels,
+                          PixelVisitor* visitor,
+                          int firstRow,
+                          int lastRow,
+                          int rowStep) const;
 
-        void visitPixels(pcl::UInt8Image* img,
-                         PixelVisitor* visitor) const;
-        void visitPixels(pcl::UInt16Image* img,
-                         PixelVisitor* visitor) const;
-        void visitPixels(pcl::UInt32Image* img,
-                         PixelVisitor* visitor) const;
-        void visitPixels(pcl::FImage* img,
-                         PixelVisitor* visitor) const;
-        void visitPixels(pcl::DImage* img,
-                         PixelVisitor* visitor) const;
+        template <typename PCLImageT>
+        void visitPCLRows(PCLImageT* img,
+                          PixelVisitor* visitor,
+                          int firstRow,
+                          int lastRow,
+                          int rowStep) const;
 
     private:
         SampleFormat _sampleFormat;
@@ -89,6 +142,10 @@ namespace ELS
             pcl::FImage* f;
             pcl::DImage* d;
         } _pixels;
+
+        // Planar samples read straight from the data block; when set
+        // _pixels is unused
+        void* _raw;
     };
 
 }
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <algorithm>
+
+#include "sha1.h"
+
+namespace ELS
+{
+
+    static inline uint32_t rotl(uint32_t x,
+                                int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    SHA1::SHA1()
+        : _state{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0},
+          _totalBytes(0),
+          _buffer(),
+          _bufferUsed(0)
+    {
+    }
+
+    void SHA1::update(const void* data,
+                      size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        _totalBytes += size;
+
+        if (_bufferUsed > 0)
+        {
+            size_t take = std::min(size, sizeof(_buffer) - _bufferUsed);
+            memcpy(_buffer + _bufferUsed, bytes, take);
+            _bufferUsed += take;
+            bytes += take;
+            size -= take;
+
+            if (_bufferUsed < sizeof(_buffer))
+            {
+                return;
+            }
+            processBlock(_buffer);
+            _bufferUsed = 0;
+        }
+
+        // Whole blocks straight from the caller's data
+        for (; size >= sizeof(_buffer); bytes += sizeof(_buffer), size -= sizeof(_buffer))
+        {
+            processBlock(bytes);
+        }
+
+        memcpy(_buffer, bytes, size);
+        _bufferUsed = size;
+    }
+
+    std::string SHA1::hexDigest()
+    {
+        // A one bit, zeros up to 8 bytes short of a block, then the
+        // length in bits, big-endian
+        uint64_t totalBits = _totalBytes * 8;
+        uint8_t padding[72] = {0x80};
+        size_t padSize = ((_bufferUsed < 56) ? 56 : 120) - _bufferUsed;
+        for (int i = 0; i < 8; i++)
+        {
+            padding[padSize + i] = (uint8_t)(totalBits >> (56 - i * 8));
+        }
+        update(padding, padSize + 8);
+
+        static const char g_hexDigits[] = "0123456789abcdef";
+        std::string digest;
+        for (int i = 0; i < 5; i++)
+        {
+            for (int shift = 28; shift >= 0; shift -= 4)
+            {
+                digest += g_hexDigits[(_state[i] >> shift) & 0xf];
+            }
+        }
+
+        return digest;
+    }
+
+    void SHA1::processBlock(const uint8_t* block)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = ((uint32_t)block[i * 4] << 24) |
+                   ((uint32_t)block[i * 4 + 1] << 16) |
+                   ((uint32_t)block[i * 4 + 2] << 8) |
+                   (uint32_t)block[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = _state[0];
+        uint32_t b = _state[1];
+        uint32_t c = _state[2];
+        uint32_t d = _state[3];
+        uint32_t e = _state[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f;
+            uint32_t k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        _state[0] += a;
+        _state[1] += b;
+        _state[2] += c;
+        _state[3] += d;
+        _state[4] += e;
+    }
+
+}
@@ -1,18 +1,239 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <lz4.h>
+#include <zlib.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "parallelfor.h"
 #include "rastertypes.h"
+#include "sha1.h"
 #include "xisfimage.h"
 #include "xisfexception.h"
 
 namespace ELS
 {
 
+    // Pull the value of the named attribute out of a single XML start
+    // tag. XISF headers are machine written, so this doesn't need to
+    // be a general XML parser
+    static bool getAttribute(const std::string& tag,
+                             const char* name,
+                             std::string* value)
+    {
+        size_t nameLen = strlen(name);
+        size_t pos = 0;
+        while ((pos = tag.find(name, pos)) != std::string::npos)
+        {
+            bool atStart = (pos > 0) && isspace((unsigned char)tag[pos - 1]);
+            size_t eq = tag.find_first_not_of(" \t\r\n", pos + nameLen);
+            if (atStart && (eq != std::string::npos) && (tag[eq] == '='))
+            {
+                size_t quote = tag.find_first_not_of(" \t\r\n", eq + 1);
+                if ((quote == std::string::npos) || ((tag[quote] != '"') && (tag[quote] != '\'')))
+                {
+                    return false;
+                }
+
+                size_t end = tag.find(tag[quote], quote + 1);
+                if (end == std::string::npos)
+                {
+                    return false;
+                }
+
+                *value = tag.substr(quote + 1, end - quote - 1);
+                return true;
+            }
+
+            pos += nameLen;
+        }
+
+        return false;
+    }
+
+    static std::vector<std::string> split(const std::string& str,
+                                          char sep)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        for (;;)
+        {
+            size_t end = str.find(sep, start);
+            parts.push_back(str.substr(start, end - start));
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            start = end + 1;
+        }
+
+        return parts;
+    }
+
+    static bool readFully(int fd,
+                          void* dst,
+                          int64_t size,
+                          int64_t offset)
+    {
+        uint8_t* p = (uint8_t*)dst;
+        while (size > 0)
+        {
+            ssize_t n = pread(fd, p, size, offset);
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= n;
+            offset += n;
+        }
+
+        return true;
+    }
+
+    // Run work(0) .. work(count - 1) across the available cores. Work
+    // items report failure by returning false; the rest are skipped
+    static bool parallelFor(int64_t count,
+                            const std::function<bool(int64_t)>& work)
+    {
+        return ParallelFor::run(count, [&](int /* slot */, int64_t i)
+                                { return work(i); });
+    }
+
+    // The checksum covers the block as stored, before decompression;
+    // an empty one always matches
+    static bool checksumMatches(const uint8_t* stored,
+                                int64_t size,
+                                const std::string& expectedSHA1)
+    {
+        if (expectedSHA1.empty())
+        {
+            return true;
+        }
+
+        SHA1 sha1;
+        sha1.update(stored, size);
+        return sha1.hexDigest() == expectedSHA1;
+    }
+
     /* static  */
     XISFImage* XISFImage::load(const char* filename)
     {
-        char errTxt[1024];
+        pcl::XISFReader reader;
+
+        reader.Open(filename);
+
+        Image::Info elsInfo = readInfo(reader, filename);
+        ELS::SampleFormat sampleFormat = elsInfo.sampleFormat;
+        bool isColor = elsInfo.isColor;
+        pcl::ImageInfo info = reader.ImageInfo();
 
+        printf("Channels: %d\n", info.numberOfChannels);
+        printf("Size: %dx%d\n", info.width, info.height);
+
+        // Read the data block ourselves when we understand its layout,
+        // skipping the intermediate PCL image
+        DataBlock block;
+        if (readDataBlockInfo(filename, elsInfo, info.numberOfChannels, &block))
+        {
+            reader.Close();
+
+            void* raw = readDataBlock(filename, block);
+            return new XISFImage(sampleFormat,
+                                 isColor,
+                                 info.width,
+                                 info.height,
+                                 raw);
+        }
+
+        XISFImage* tmp = 0;
+        switch (sampleFormat)
+        {
+        case ELS::SF_INT_8:
+        case ELS::SF_UINT_8:
+        {
+            pcl::UInt8Image* img = new pcl::UInt8Image();
+            reader.ReadImage(*img);
+            tmp = new XISFImage(sampleFormat,
+                                isColor,
+                                info.width,
+                                info.height,
+                                img);
+        }
+        break;
+        case ELS::SF_INT_16:
+        case ELS::SF_UINT_16:
+        {
+            pcl::UInt16Image* img = new pcl::UInt16Image();
+            reader.ReadImage(*img);
+            tmp = new XISFImage(sampleFormat,
+                                isColor,
+                                info.width,
+                                info.height,
+                                img);
+        }
+        break;
+        case ELS::SF_INT_32:
+        case ELS::SF_UINT_32:
+        {
+            pcl::UInt32Image* img = new pcl::UInt32Image();
+            reader.ReadImage(*img);
+            tmp = new XISFImage(sampleFormat,
+                                isColor,
+                                info.width,
+                                info.height,
+                                img);
+        }
+        break;
+        case ELS::SF_FLOAT:
+        {
+            pcl::FImage* img = new pcl::FImage();
+            reader.ReadImage(*img);
+            tmp = new XISFImage(sampleFormat,
+                                isColor,
+                                info.width,
+                                info.height,
+                                img);
+        }
+        break;
+        case ELS::SF_DOUBLE:
+        {
+            pcl::DImage* img = new pcl::DImage();
+            reader.ReadImage(*img);
+            tmp = new XISFImage(sampleFormat,
+                                isColor,
+                                info.width,
+                                info.height,
+                                img);
+        }
+        break;
+        }
+
+        reader.Close();
+
+        return tmp;
+    }
+
+    /* static */
+    Image::Info XISFImage::readInfo(const char* filename)
+    {
         pcl::XISFReader reader;
 
         reader.Open(filename);
+        Image::Info info = readInfo(reader, filename);
+        reader.Close();
+
+        return info;
+    }
+
+    /* static */
+    Image::Info XISFImage::readInfo(pcl::XISFReader& reader,
+                                    const char* filename)
+    {
+        char errTxt[1024];
 
         pcl::ImageOptions options = reader.ImageOptions();
         pcl::ImageInfo info = reader.ImageInfo();
@@ -131,75 +352,358 @@ namespace ELS
             break;
         }
 
-        printf("Channels: %d\n", info.numberOfChannels);
-        printf("Size: %dx%d\n", info.width, info.height);
+        Image::Info elsInfo;
+        elsInfo.fileType = FT_XISF;
+        elsInfo.width = info.width;
+        elsInfo.height = info.height;
+        elsInfo.isColor = isColor;
+        elsInfo.sampleFormat = sampleFormat;
+        elsInfo.rasterFormat = ELS::RF_PLANAR;
+
+        // The header is already parsed by Open(), so this is cheap
+        pcl::FITSKeywordArray keywords = reader.ReadFITSKeywords();
+        for (pcl::FITSKeywordArray::const_iterator i = keywords.Begin(); i != keywords.End(); ++i)
+        {
+            std::string value(i->StripValueDelimiters().c_str());
+            if (i->name == "DATE-OBS")
+            {
+                elsInfo.dateObs = value;
+            }
+            else if (i->name == "EXPTIME")
+            {
+                elsInfo.exposure = value;
+            }
+            else if (i->name == "FILTER")
+            {
+                elsInfo.filter = value;
+            }
+            else if (i->name == "OBJECT")
+            {
+                elsInfo.object = value;
+            }
+        }
 
-        XISFImage* tmp = 0;
-        switch (sampleFormat)
+        return elsInfo;
+    }
+
+    /* static */
+    bool XISFImage::readDataBlockInfo(const char* filename,
+                                      const Image::Info& info,
+                                      int channelCount,
+                                      DataBlock* block)
+    {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
         {
-        case ELS::SF_INT_8:
-        case ELS::SF_UINT_8:
+            return false;
+        }
+
+        // Signature, header length and reserved word, then the XML
+        uint8_t prefix[16];
+        if (!readFully(fd, prefix, sizeof(prefix), 0) ||
+            (memcmp(prefix, "XISF0100", 8) != 0))
         {
-            pcl::UInt8Image* img = new pcl::UInt8Image();
-            reader.ReadImage(*img);
-            tmp = new XISFImage(sampleFormat,
-                                isColor,
-                                info.width,
-                                info.height,
-                                img);
+            close(fd);
+            return false;
         }
-        break;
-        case ELS::SF_INT_16:
-        case ELS::SF_UINT_16:
+
+        uint32_t headerLength = prefix[8] |
+                                (prefix[9] << 8) |
+                                (prefix[10] << 16) |
+                                ((uint32_t)prefix[11] << 24);
+
+        std::string header(headerLength, '\0');
+        bool headerRead = readFully(fd, &header[0], headerLength, sizeof(prefix));
+        close(fd);
+        if (!headerRead)
         {
-            pcl::UInt16Image* img = new pcl::UInt16Image();
-            reader.ReadImage(*img);
-            tmp = new XISFImage(sampleFormat,
-                                isColor,
-                                info.width,
-                                info.height,
-                                img);
+            return false;
         }
-        break;
-        case ELS::SF_INT_32:
-        case ELS::SF_UINT_32:
+
+        size_t tagStart = header.find("<Image");
+        while ((tagStart != std::string::npos) &&
+               !isspace((unsigned char)header[tagStart + 6]))
         {
-            pcl::UInt32Image* img = new pcl::UInt32Image();
-            reader.ReadImage(*img);
-            tmp = new XISFImage(sampleFormat,
-                                isColor,
-                                info.width,
-                                info.height,
-                                img);
+            tagStart = header.find("<Image", tagStart + 6);
         }
-        break;
-        case ELS::SF_FLOAT:
+        if (tagStart == std::string::npos)
         {
-            pcl::FImage* img = new pcl::FImage();
-            reader.ReadImage(*img);
-            tmp = new XISFImage(sampleFormat,
-                                isColor,
-                                info.width,
-                                info.height,
-                                img);
+            return false;
         }
-        break;
-        case ELS::SF_DOUBLE:
+        std::string tag = header.substr(tagStart, header.find('>', tagStart) - tagStart);
+
+        std::string value;
+        int64_t bytesPerSample = getBytesPerSample(info.sampleFormat);
+        int64_t rawSize = (int64_t)info.width * info.height * channelCount * bytesPerSample;
+
+        // Only planar, little-endian, attached blocks are handled here;
+        // anything else goes through PCL
+        if ((channelCount < (info.isColor ? 3 : 1)) ||
+            (getAttribute(tag, "pixelStorage", &value) && (value != "Planar")) ||
+            (getAttribute(tag, "byteOrder", &value) && (value != "little")))
         {
-            pcl::DImage* img = new pcl::DImage();
-            reader.ReadImage(*img);
-            tmp = new XISFImage(sampleFormat,
-                                isColor,
-                                info.width,
-                                info.height,
-                                img);
+            return false;
         }
-        break;
+
+        if (!getAttribute(tag, "location", &value))
+        {
+            return false;
+        }
+        std::vector<std::string> location = split(value, ':');
+        if ((location.size() != 3) || (location[0] != "attachment"))
+        {
+            return false;
+        }
+        block->position = strtoll(location[1].c_str(), 0, 10);
+        block->size = strtoll(location[2].c_str(), 0, 10);
+
+        block->codec = C_NONE;
+        block->isByteShuffled = false;
+        block->itemSize = 1;
+        block->uncompressedSize = block->size;
+        block->subblocks.clear();
+        block->sha1.clear();
+
+        // Only SHA-1 is checked here; other digests are left to PCL
+        if (getAttribute(tag, "checksum", &value))
+        {
+            std::vector<std::string> checksum = split(value, ':');
+            if ((checksum.size() != 2) ||
+                ((checksum[0] != "sha1") && (checksum[0] != "sha-1")) ||
+                (checksum[1].size() != 40))
+            {
+                return false;
+            }
+
+            block->sha1 = checksum[1];
+            std::transform(block->sha1.begin(), block->sha1.end(), block->sha1.begin(),
+                           [](unsigned char c)
+                           { return (char)tolower(c); });
         }
 
-        reader.Close();
+        if (getAttribute(tag, "compression", &value))
+        {
+            std::vector<std::string> compression = split(value, ':');
+            if (compression.size() < 2)
+            {
+                return false;
+            }
 
-        return tmp;
+            std::string codec = compression[0];
+            size_t plus = codec.find("+sh");
+            if (plus != std::string::npos)
+            {
+                if ((plus + 3 != codec.size()) || (compression.size() < 3))
+                {
+                    return false;
+                }
+                codec = codec.substr(0, plus);
+                block->isByteShuffled = true;
+                block->itemSize = atoi(compression[2].c_str());
+            }
+
+            if (codec == "zlib")
+            {
+                block->codec = C_ZLIB;
+            }
+            else if ((codec == "lz4") || (codec == "lz4hc"))
+            {
+                // LZ4HC only differs on the compression side
+                block->codec = C_LZ4;
+            }
+            else
+            {
+                return false;
+            }
+
+            block->uncompressedSize = strtoll(compression[1].c_str(), 0, 10);
+
+            // Large blocks are split into independently compressed
+            // subblocks, which is what lets them decompress in parallel
+            if (getAttribute(tag, "subblocks", &value))
+            {
+                std::vector<std::string> subblocks = split(value, ':');
+                for (std::vector<std::string>::iterator i = subblocks.begin(); i != subblocks.end(); ++i)
+                {
+                    std::vector<std::string> sizes = split(*i, ',');
+                    if (sizes.size() != 2)
+                    {
+                        return false;
+                    }
+                    block->subblocks.push_back(std::make_pair(strtoll(sizes[0].c_str(), 0, 10),
+                                                              strtoll(sizes[1].c_str(), 0, 10)));
+                }
+            }
+            else
+            {
+                block->subblocks.push_back(std::make_pair(block->size,
+                                                          block->uncompressedSize));
+            }
+
+            int64_t compressedTotal = 0;
+            int64_t uncompressedTotal = 0;
+            for (std::vector<std::pair<int64_t, int64_t>>::iterator i = block->subblocks.begin(); i != block->subblocks.end(); ++i)
+            {
+                compressedTotal += i->first;
+                uncompressedTotal += i->second;
+            }
+            if ((compressedTotal > block->size) ||
+                (uncompressedTotal != block->uncompressedSize) ||
+                (block->itemSize <= 0))
+            {
+                return false;
+            }
+        }
+
+        return (block->position > 0) && (block->uncompressedSize == rawSize);
+    }
+
+    /* static */
+    void* XISFImage::readDataBlock(const char* filename,
+                                   const DataBlock& block)
+    {
+        char errTxt[1024];
+
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            sprintf(errTxt, "Could not open '%s'", filename);
+            throw new XISFException(errTxt);
+        }
+
+        size_t allocSize = (block.uncompressedSize + 63) & ~(size_t)63;
+        uint8_t* raw = (uint8_t*)aligned_alloc(64, std::max(allocSize, (size_t)64));
+        if (raw == 0)
+        {
+            close(fd);
+            throw new XISFException("Out of memory reading XISF data block");
+        }
+
+        if (block.codec == C_NONE)
+        {
+            bool ok = readFully(fd, raw, block.size, block.position);
+            close(fd);
+            if (!ok)
+            {
+                free(raw);
+                sprintf(errTxt, "Short read on data block of '%s'", filename);
+                throw new XISFException(errTxt);
+            }
+            if (!checksumMatches(raw, block.size, block.sha1))
+            {
+                free(raw);
+                sprintf(errTxt, "Checksum mismatch on data block of '%s'", filename);
+                throw new XISFException(errTxt);
+            }
+
+            return raw;
+        }
+
+        std::vector<uint8_t> compressed(block.size);
+        bool ok = readFully(fd, compressed.data(), block.size, block.position);
+        close(fd);
+        if (!ok)
+        {
+            free(raw);
+            sprintf(errTxt, "Short read on data block of '%s'", filename);
+            throw new XISFException(errTxt);
+        }
+        if (!checksumMatches(compressed.data(), block.size, block.sha1))
+        {
+            free(raw);
+            sprintf(errTxt, "Checksum mismatch on data block of '%s'", filename);
+            throw new XISFException(errTxt);
+        }
+
+        // Shuffled data has to be unshuffled out of a staging buffer;
+        // otherwise subblocks decompress straight into place
+        std::vector<uint8_t> staging;
+        uint8_t* decompressed = raw;
+        if (block.isByteShuffled && (block.itemSize > 1))
+        {
+            staging.resize(block.uncompressedSize);
+            decompressed = staging.data();
+        }
+
+        std::vector<int64_t> srcOffsets(1, 0);
+        std::vector<int64_t> dstOffsets(1, 0);
+        for (size_t i = 0; i < block.subblocks.size(); i++)
+        {
+            srcOffsets.push_back(srcOffsets.back() + block.subblocks[i].first);
+            dstOffsets.push_back(dstOffsets.back() + block.subblocks[i].second);
+        }
+
+        ok = parallelFor(block.subblocks.size(), [&](int64_t i)
+                         {
+                             const uint8_t* src = compressed.data() + srcOffsets[i];
+                             uint8_t* dst = decompressed + dstOffsets[i];
+                             int64_t srcSize = block.subblocks[i].first;
+                             int64_t dstSize = block.subblocks[i].second;
+
+                             if (block.codec == C_ZLIB)
+                             {
+                                 uLongf dstLen = dstSize;
+                                 return (uncompress(dst, &dstLen, src, srcSize) == Z_OK) &&
+                                        ((int64_t)dstLen == dstSize);
+                             }
+
+                             return LZ4_decompress_safe((const char*)src,
+                                                        (char*)dst,
+                                                        (int)srcSize,
+                                                        (int)dstSize) == dstSize;
+                         });
+        if (!ok)
+        {
+            free(raw);
+            sprintf(errTxt, "Could not decompress data block of '%s'", filename);
+            throw new XISFException(errTxt);
+        }
+
+        if (decompressed != raw)
+        {
+            // Byte n of every item is stored together; trailing bytes
+            // that don't make a whole item are stored as-is
+            const int64_t itemSize = block.itemSize;
+            const int64_t itemCount = block.uncompressedSize / itemSize;
+            const int64_t chunkItems = 1 << 20;
+            const int64_t chunkCount = (itemCount + chunkItems - 1) / chunkItems;
+
+            parallelFor(chunkCount, [&](int64_t chunk)
+                        {
+                            int64_t first = chunk * chunkItems;
+                            int64_t last = std::min(first + chunkItems, itemCount);
+                            for (int64_t b = 0; b < itemSize; b++)
+                            {
+                                const uint8_t* src = decompressed + b * itemCount;
+                                uint8_t* dst = raw + b;
+                                for (int64_t i = first; i < last; i++)
+                                {
+                                    dst[i * itemSize] = src[i];
+                                }
+                            }
+                            return true;
+                        });
+
+            memcpy(raw + itemCount * itemSize,
+                   decompressed + itemCount * itemSize,
+                   block.uncompressedSize - itemCount * itemSize);
+        }
+
+        return raw;
+    }
+
+    XISFImage::XISFImage(SampleFormat sampleFormat,
+                         bool isColor,
+                         int width,
+                         int height,
+                         void* raw)
+        : _sampleFormat(sampleFormat),
+          _isColor(isColor),
+          _width(width),
+          _height(height),
+          _pixels({.u8 = 0}),
+          _raw(raw)
+    {
     }
 
     XISFImage::XISFImage(SampleFormat sampleFormat,
@@ -211,7 +715,8 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels({.u8 = img})
+          _pixels({.u8 = img}),
+          _raw(0)
     {
     }
 
@@ -224,7 +729,8 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels({.u16 = img})
+          _pixels({.u16 = img}),
+          _raw(0)
     {
     }
 
@@ -237,7 +743,8 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels({.u32 = img})
+          _pixels({.u32 = img}),
+          _raw(0)
     {
     }
 
@@ -250,7 +757,8 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels({.f = img})
+          _pixels({.f = img}),
+          _raw(0)
     {
     }
 
@@ -263,12 +771,20 @@ namespace ELS
           _isColor(isColor),
           _width(width),
           _height(height),
-          _pixels({.d = img})
+          _pixels({.d = img}),
+          _raw(0)
     {
     }
 
     XISFImage::~XISFImage()
     {
+        if (_raw != 0)
+        {
+            free(_raw);
+            _raw = 0;
+            return;
+        }
+
         switch (_sampleFormat)
         {
         case ELS::SF_INT_8:
@@ -337,216 +853,128 @@ namespace ELS
         return _sampleFormat;
     }
 
-    void XISFImage::visitPixels(PixelVisitor* visitor) const
+    const uint8_t* XISFImage::getGrayBytes() const
     {
+        if (_isColor || (_sampleFormat != SF_UINT_8))
+        {
+            return 0;
+        }
+
+        if (_raw != 0)
+        {
+            return (const uint8_t*)_raw;
+        }
+
+        return _pixels.u8->ScanLine(0, 0);
+    }
+
+    void XISFImage::visitRows(PixelVisitor* visitor,
+                              int firstRow,
+                              int lastRow,
+                              int rowStep) const
+    {
+        if (_raw != 0)
+        {
+            switch (_sampleFormat)
+            {
+            case SF_INT_8:
+            case SF_UINT_8:
+                visitRawRows((const uint8_t*)_raw, visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_INT_16:
+            case SF_UINT_16:
+                visitRawRows((const uint16_t*)_raw, visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_INT_32:
+            case SF_UINT_32:
+                visitRawRows((const uint32_t*)_raw, visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_FLOAT:
+                visitRawRows((const float*)_raw, visitor, firstRow, lastRow, rowStep);
+                break;
+            case SF_DOUBLE:
+                visitRawRows((const double*)_raw, visitor, firstRow, lastRow, rowStep);
+                break;
+            }
+            return;
+        }
+
         switch (_sampleFormat)
         {
         case SF_INT_8:
         case SF_UINT_8:
-            visitPixels(_pixels.u8,
-                        visitor);
+            visitPCLRows(_pixels.u8, visitor, firstRow, lastRow, rowStep);
             break;
         case SF_INT_16:
         case SF_UINT_16:
-            visitPixels(_pixels.u16,
-                        visitor);
+            visitPCLRows(_pixels.u16, visitor, firstRow, lastRow, rowStep);
             break;
         case SF_INT_32:
         case SF_UINT_32:
-            visitPixels(_pixels.u32,
-                        visitor);
+            visitPCLRows(_pixels.u32, visitor, firstRow, lastRow, rowStep);
             break;
         case SF_FLOAT:
-            visitPixels(_pixels.f,
-                        visitor);
+            visitPCLRows(_pixels.f, visitor, firstRow, lastRow, rowStep);
             break;
         case SF_DOUBLE:
-            visitPixels(_pixels.d,
-                        visitor);
+            visitPCLRows(_pixels.d, visitor, firstRow, lastRow, rowStep);
             break;
         }
     }
 
-    void XISFImage::visitPixels(pcl::UInt8Image* img,
-                                PixelVisitor* visitor) const
-    {
-        if (!_isColor)
-        {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                uint8_t* k = img->ScanLine(y, 0);
-                visitor->rowGray(y, k);
-            }
-            visitor->done();
-        }
-        else
-        {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                uint8_t* rgb[3];
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    rgb[chan] = img->ScanLine(y, chan);
-                }
-
-                visitor->rowRgb(y,
-                                rgb[0],
-                                rgb[1],
-                                rgb[2]);
-            }
-            visitor->done();
-        }
-    }
-
-    void XISFImage::visitPixels(pcl::UInt16Image* img,
-                                PixelVisitor* visitor) const
+    template <typename PixelT>
+    void XISFImage::visitRawRows(const PixelT* pixels,
+                                 PixelVisitor* visitor,
+                                 int firstRow,
+                                 int lastRow,
+                                 int rowStep) const
     {
-        if (!_isColor)
-        {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                uint16_t* k = img->ScanLine(y, 0);
-                visitor->rowGray(y, k);
-            }
-            visitor->done();
-        }
-        else
-        {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                uint16_t* rgb[3];
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    rgb[chan] = img->ScanLine(y, chan);
-                }
+        int64_t planeSize = (int64_t)_width * _height;
 
-                visitor->rowRgb(y,
-                                rgb[0],
-                                rgb[1],
-                                rgb[2]);
-            }
-            visitor->done();
-        }
-    }
-    void XISFImage::visitPixels(pcl::UInt32Image* img,
-                                PixelVisitor* visitor) const
-    {
         if (!_isColor)
         {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                uint32_t* k = img->ScanLine(y, 0);
-                visitor->rowGray(y, k);
+                visitor->rowGray(y, pixels + (int64_t)y * _width);
             }
-            visitor->done();
         }
         else
         {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                uint32_t* rgb[3];
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    rgb[chan] = img->ScanLine(y, chan);
-                }
-
+                int64_t offset = (int64_t)y * _width;
                 visitor->rowRgb(y,
-                                rgb[0],
-                                rgb[1],
-                                rgb[2]);
+                                pixels + offset,
+                                pixels + planeSize + offset,
+                                pixels + 2 * planeSize + offset);
             }
-            visitor->done();
         }
     }
-    void XISFImage::visitPixels(pcl::FImage* img,
-                                PixelVisitor* visitor) const
-    {
-        if (!_isColor)
-        {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                float* k = img->ScanLine(y, 0);
-                visitor->rowGray(y, k);
-            }
-            visitor->done();
-        }
-        else
-        {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
-            {
-                float* rgb[3];
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    rgb[chan] = img->ScanLine(y, chan);
-                }
 
-                visitor->rowRgb(y,
-                                rgb[0],
-                                rgb[1],
-                                rgb[2]);
-            }
-            visitor->done();
-        }
-    }
-    void XISFImage::visitPixels(pcl::DImage* img,
-                                PixelVisitor* visitor) const
+    template <typename PCLImageT>
+    void XISFImage::visitPCLRows(PCLImageT* img,
+                                 PixelVisitor* visitor,
+                                 int firstRow,
+                                 int lastRow,
+                                 int rowStep) const
     {
         if (!_isColor)
         {
-            visitor->pixelFormat(ELS::PF_GRAY);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                double* k = img->ScanLine(y, 0);
-                visitor->rowGray(y, k);
+                visitor->rowGray(y, img->ScanLine(y, 0));
             }
-            visitor->done();
         }
         else
         {
-            visitor->pixelFormat(ELS::PF_RGB);
-            visitor->dimensions(_width, _height);
-            visitor->rowInfo(1);
-            for (int y = 0; y < _height; y++)
+            for (int y = firstRow; y < lastRow; y += rowStep)
             {
-                double* rgb[3];
-                for (int chan = 0; chan < 3; chan++)
-                {
-                    rgb[chan] = img->ScanLine(y, chan);
-                }
-
                 visitor->rowRgb(y,
-                                rgb[0],
-                                rgb[1],
-                                rgb[2]);
+                                img->ScanLine(y, 0),
+                                img->ScanLine(y, 1),
+                                img->ScanLine(y, 2));
             }
-            visitor->done();
         }
     }
 
-}
\ No newline at end of file
+}